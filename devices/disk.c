@@ -48,6 +48,10 @@
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
 
+/* Most sectors one READ/WRITE SECTOR command can move (a sector
+   count of 0 means 256). */
+#define MAX_CMD_SECTORS 256
+
 /* An ATA device. */
 struct disk {
 	char name[8];               /* Name, e.g. "hd0:1". */
@@ -59,6 +63,7 @@ struct disk {
 
 	long long read_cnt;         /* Number of sectors read. */
 	long long write_cnt;        /* Number of sectors written. */
+	long long cmd_cnt;          /* Number of read/write commands. */
 };
 
 /* An ATA channel (aka controller).
@@ -84,7 +89,7 @@ static void reset_channel (struct channel *);
 static bool check_device_type (struct disk *);
 static void identify_ata_device (struct disk *);
 
-static void select_sector (struct disk *, disk_sector_t);
+static void select_sector (struct disk *, disk_sector_t, size_t cnt);
 static void issue_pio_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
@@ -133,7 +138,7 @@ disk_init (void) {
 			d->is_ata = false;
 			d->capacity = 0;
 
-			d->read_cnt = d->write_cnt = 0;
+			d->read_cnt = d->write_cnt = d->cmd_cnt = 0;
 		}
 
 		/* Register interrupt handler. */
@@ -167,8 +172,8 @@ disk_print_stats (void) {
 		for (dev_no = 0; dev_no < 2; dev_no++) {
 			struct disk *d = disk_get (chan_no, dev_no);
 			if (d != NULL && d->is_ata)
-				printf ("%s: %lld reads, %lld writes\n",
-						d->name, d->read_cnt, d->write_cnt);
+				printf ("%s: %lld reads, %lld writes, %lld commands\n",
+						d->name, d->read_cnt, d->write_cnt, d->cmd_cnt);
 		}
 	}
 }
@@ -203,29 +208,80 @@ disk_size (struct disk *d) {
 	return d->capacity;
 }
 
-/* Reads sector SEC_NO from disk D into BUFFER, which must have
-   room for DISK_SECTOR_SIZE bytes.
-   Internally synchronizes accesses to disks, so external
-   per-disk locking is unneeded. */
-void
-disk_read (struct disk *d, disk_sector_t sec_no, void *buffer) {
+/* Moves the sectors described by IOV, IOV_CNT pieces in all,
+   between disk D and memory, starting at sector SEC_NO and
+   writing if WRITE is true.  Up to MAX_CMD_SECTORS go in a single
+   command, so the whole transfer takes one command round trip per
+   256 sectors instead of one per sector. */
+static void
+transfer (struct disk *d, disk_sector_t sec_no,
+		const struct disk_iovec *iov, size_t iov_cnt, bool write) {
 	struct channel *c;
+	size_t left = 0;
+	size_t iov_ofs = 0;         /* Next sector within *IOV. */
 
 	ASSERT (d != NULL);
-	ASSERT (buffer != NULL);
+	ASSERT (iov != NULL);
+
+	for (size_t i = 0; i < iov_cnt; i++)
+		left += iov[i].sector_cnt;
 
 	c = d->channel;
 	lock_acquire (&c->lock);
-	select_sector (d, sec_no);
-	issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-	sema_down (&c->completion_wait);
-	if (!wait_while_busy (d))
-		PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-	input_sector (c, buffer);
-	d->read_cnt++;
+	while (left > 0) {
+		size_t cnt = left < MAX_CMD_SECTORS ? left : MAX_CMD_SECTORS;
+
+		select_sector (d, sec_no, cnt);
+		issue_pio_command (c, write ? CMD_WRITE_SECTOR_RETRY
+				: CMD_READ_SECTOR_RETRY);
+		for (size_t i = 0; i < cnt; i++) {
+			uint8_t *buffer;
+
+			while (iov_ofs == iov->sector_cnt) {
+				iov++;
+				iov_ofs = 0;
+			}
+			ASSERT (iov->buffer != NULL);
+			buffer = (uint8_t *) iov->buffer + iov_ofs++ * DISK_SECTOR_SIZE;
+
+			/* The disk interrupts once a sector's data is ready to be
+			   read, and once a written sector has been taken. */
+			if (write) {
+				if (!wait_while_busy (d))
+					PANIC ("%s: disk write failed, sector=%"PRDSNu,
+							d->name, (disk_sector_t) (sec_no + i));
+				output_sector (c, buffer);
+				sema_down (&c->completion_wait);
+			} else {
+				sema_down (&c->completion_wait);
+				if (!wait_while_busy (d))
+					PANIC ("%s: disk read failed, sector=%"PRDSNu,
+							d->name, (disk_sector_t) (sec_no + i));
+				input_sector (c, buffer);
+			}
+		}
+		if (write)
+			d->write_cnt += cnt;
+		else
+			d->read_cnt += cnt;
+		d->cmd_cnt++;
+		sec_no += cnt;
+		left -= cnt;
+	}
 	lock_release (&c->lock);
 }
 
+/* Reads sector SEC_NO from disk D into BUFFER, which must have
+   room for DISK_SECTOR_SIZE bytes.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+void
+disk_read (struct disk *d, disk_sector_t sec_no, void *buffer) {
+	struct disk_iovec iov = { buffer, 1 };
+
+	transfer (d, sec_no, &iov, 1, false);
+}
+
 /* Write sector SEC_NO to disk D from BUFFER, which must contain
    DISK_SECTOR_SIZE bytes.  Returns after the disk has
    acknowledged receiving the data.
@@ -233,23 +289,29 @@ disk_read (struct disk *d, disk_sector_t sec_no, void *buffer) {
    per-disk locking is unneeded. */
 void
 disk_write (struct disk *d, disk_sector_t sec_no, const void *buffer) {
-	struct channel *c;
+	struct disk_iovec iov = { (void *) buffer, 1 };
 
-	ASSERT (d != NULL);
-	ASSERT (buffer != NULL);
+	transfer (d, sec_no, &iov, 1, true);
+}
 
-	c = d->channel;
-	lock_acquire (&c->lock);
-	select_sector (d, sec_no);
-	issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-	if (!wait_while_busy (d))
-		PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-	output_sector (c, buffer);
-	sema_down (&c->completion_wait);
-	d->write_cnt++;
-	lock_release (&c->lock);
+/* Reads consecutive sectors of disk D, starting at SEC_NO, into
+   the IOV_CNT buffers of IOV in turn, each taking as many sectors
+   as its SECTOR_CNT says.  Uses one command per 256 sectors. */
+void
+disk_readv (struct disk *d, disk_sector_t sec_no,
+		const struct disk_iovec *iov, size_t iov_cnt) {
+	transfer (d, sec_no, iov, iov_cnt, false);
 }
-
+
+/* Writes the IOV_CNT buffers of IOV to consecutive sectors of disk
+   D, starting at SEC_NO.  Returns after the disk has acknowledged
+   receiving the data.  Uses one command per 256 sectors. */
+void
+disk_writev (struct disk *d, disk_sector_t sec_no,
+		const struct disk_iovec *iov, size_t iov_cnt) {
+	transfer (d, sec_no, iov, iov_cnt, true);
+}
+
 /* Disk detection and identification. */
 
 static void print_ata_string (char *string, size_t size);
@@ -402,17 +464,18 @@ print_ata_string (char *string, size_t size) {
 }
 
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and the sector count CNT to the disk's sector
+   selection registers.  (We use LBA mode.) */
 static void
-select_sector (struct disk *d, disk_sector_t sec_no) {
+select_sector (struct disk *d, disk_sector_t sec_no, size_t cnt) {
 	struct channel *c = d->channel;
 
-	ASSERT (sec_no < d->capacity);
-	ASSERT (sec_no < (1UL << 28));
+	ASSERT (cnt > 0 && cnt <= MAX_CMD_SECTORS);
+	ASSERT (sec_no + cnt <= d->capacity);
+	ASSERT (sec_no + cnt <= (1UL << 28));
 
 	select_device_wait (d);
-	outb (reg_nsect (c), 1);
+	outb (reg_nsect (c), cnt);
 	outb (reg_lbal (c), sec_no);
 	outb (reg_lbam (c), sec_no >> 8);
 	outb (reg_lbah (c), (sec_no >> 16));
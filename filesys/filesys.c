@@ -49,6 +49,9 @@ filesys_done (void) {
 #ifdef EFILESYS
 	fat_close ();
 #else
+#ifdef VM
+	inode_sync_all ();
+#endif
 	free_map_close ();
 #endif
 }
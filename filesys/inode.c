@@ -6,6 +6,11 @@
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "threads/malloc.h"
+#include "threads/vaddr.h"
+#ifdef VM
+#include "threads/synch.h"
+#include "vm/vm.h"
+#endif
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
@@ -34,6 +39,12 @@ struct inode {
 	bool removed;                       /* True if deleted, false otherwise. */
 	int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
 	struct inode_disk data;             /* Inode content. */
+#ifdef VM
+	struct radix cache;                 /* Page cache: page number ->
+	                                       struct page. */
+	struct lock cache_lock;             /* Orders reads into the page
+	                                       cache with writes to disk. */
+#endif
 };
 
 /* Returns the disk sector that contains byte offset POS within
@@ -125,6 +136,10 @@ inode_open (disk_sector_t sector) {
 	inode->open_cnt = 1;
 	inode->deny_write_cnt = 0;
 	inode->removed = false;
+#ifdef VM
+	radix_init (&inode->cache);
+	lock_init (&inode->cache_lock);
+#endif
 	disk_read (filesys_disk, inode->sector, &inode->data);
 	return inode;
 }
@@ -156,6 +171,9 @@ inode_close (struct inode *inode) {
 	if (--inode->open_cnt == 0) {
 		/* Remove from inode list and release lock. */
 		list_remove (&inode->elem);
+#ifdef VM
+		page_cache_drop (inode, !inode->removed);
+#endif
 
 		/* Deallocate blocks if removed. */
 		if (inode->removed) {
@@ -200,6 +218,11 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) {
 		if (chunk_size <= 0)
 			break;
 
+#ifdef VM
+		if (page_cache_rw (inode, offset, buffer + bytes_read, chunk_size,
+					false))
+			goto advance;
+#endif
 		if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) {
 			/* Read full sector directly into caller's buffer. */
 			disk_read (filesys_disk, sector_idx, buffer + bytes_read); 
@@ -215,6 +238,7 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) {
 			memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
 		}
 
+advance:
 		/* Advance. */
 		size -= chunk_size;
 		offset += chunk_size;
@@ -225,6 +249,93 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) {
 	return bytes_read;
 }
 
+/* Reads the CNT pages of INODE that start at OFFSET, which must be
+ * sector-aligned, into PAGES[0], PAGES[1], and so on, with a single
+ * disk command.  Stops at end of file; the rest of the sector
+ * holding the last byte is read too.  Returns the number of bytes of
+ * the file read.
+ *
+ * Relies on the data of an inode being contiguous on disk. */
+off_t
+inode_read_pages (struct inode *inode, void *const pages[], size_t cnt,
+		off_t offset) {
+	struct disk_iovec iov[INODE_READ_PAGES_MAX];
+	off_t length = inode_length (inode);
+	off_t bytes_read = 0;
+	size_t i;
+
+	ASSERT (offset % DISK_SECTOR_SIZE == 0);
+	ASSERT (cnt <= INODE_READ_PAGES_MAX);
+
+	for (i = 0; i < cnt && offset + bytes_read < length; i++) {
+		off_t inode_left = length - (offset + bytes_read);
+		off_t chunk_size = inode_left < PGSIZE ? inode_left : PGSIZE;
+
+		iov[i].buffer = pages[i];
+		iov[i].sector_cnt = DIV_ROUND_UP (chunk_size, DISK_SECTOR_SIZE);
+		bytes_read += chunk_size;
+	}
+	if (i > 0)
+		disk_readv (filesys_disk, byte_to_sector (inode, offset), iov, i);
+	return bytes_read;
+}
+
+#ifdef VM
+/* Writes PAGES[0], PAGES[1], and so on, the CNT pages of INODE's
+ * data that start at page-aligned OFFSET, back to disk with a single
+ * disk command, up to end of file.  Returns the number of bytes of
+ * the file written. */
+off_t
+inode_write_pages (struct inode *inode, const void *const pages[],
+		size_t cnt, off_t offset) {
+	struct disk_iovec iov[INODE_READ_PAGES_MAX];
+	off_t length = inode_length (inode);
+	off_t bytes_written = 0;
+	size_t i;
+
+	ASSERT (offset % PGSIZE == 0);
+	ASSERT (cnt <= INODE_READ_PAGES_MAX);
+
+	if (inode->deny_write_cnt)
+		return 0;
+	for (i = 0; i < cnt && offset + bytes_written < length; i++) {
+		off_t inode_left = length - (offset + bytes_written);
+		off_t chunk_size = inode_left < PGSIZE ? inode_left : PGSIZE;
+
+		iov[i].buffer = (void *) pages[i];
+		iov[i].sector_cnt = DIV_ROUND_UP (chunk_size, DISK_SECTOR_SIZE);
+		bytes_written += chunk_size;
+	}
+	if (i > 0)
+		disk_writev (filesys_disk, byte_to_sector (inode, offset), iov, i);
+	return bytes_written;
+}
+
+/* Returns INODE's page cache. */
+struct radix *
+inode_page_cache (struct inode *inode) {
+	return &inode->cache;
+}
+
+/* Returns the lock that orders reads into INODE's page cache with
+ * writes to INODE's data on disk. */
+struct lock *
+inode_page_cache_lock (struct inode *inode) {
+	return &inode->cache_lock;
+}
+
+/* Writes the dirty page cache pages of every open inode back to
+ * disk. */
+void
+inode_sync_all (void) {
+	struct list_elem *e;
+
+	for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
+			e = list_next (e))
+		page_cache_sync (list_entry (e, struct inode, elem));
+}
+#endif
+
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
  * Returns the number of bytes actually written, which may be
  * less than SIZE if end of file is reached or an error occurs.
@@ -240,6 +351,11 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 	if (inode->deny_write_cnt)
 		return 0;
 
+#ifdef VM
+	/* Pages in the page cache are written there.  The others are
+	 * written to disk, and must not be read into it meanwhile. */
+	lock_acquire (&inode->cache_lock);
+#endif
 	while (size > 0) {
 		/* Sector to write, starting byte offset within sector. */
 		disk_sector_t sector_idx = byte_to_sector (inode, offset);
@@ -255,6 +371,11 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 		if (chunk_size <= 0)
 			break;
 
+#ifdef VM
+		if (page_cache_rw (inode, offset, (void *) buffer + bytes_written,
+					chunk_size, true))
+			goto advance;
+#endif
 		if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) {
 			/* Write full sector directly to disk. */
 			disk_write (filesys_disk, sector_idx, buffer + bytes_written); 
@@ -277,11 +398,15 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 			disk_write (filesys_disk, sector_idx, bounce); 
 		}
 
+advance:
 		/* Advance. */
 		size -= chunk_size;
 		offset += chunk_size;
 		bytes_written += chunk_size;
 	}
+#ifdef VM
+	lock_release (&inode->cache_lock);
+#endif
 	free (bounce);
 
 	return bytes_written;
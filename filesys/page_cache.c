@@ -1,10 +1,35 @@
-/* page_cache.c: Implementation of Page Cache (Buffer Cache). */
+/* page_cache.c: Implementation of Page Cache (Buffer Cache).
+ *
+ * Each inode keeps the pages of its file that have been mapped in a
+ * radix tree, keyed by page number.  A page cache page is a struct
+ * page that belongs to no process and is in no page table.  Every
+ * mapping of the file page maps its frame (see file_claim_page()),
+ * and read() and write() copy through it while it is resident, so
+ * they all see the same bytes.
+ *
+ * The frame is evicted by the clock like any other.  Dirty data is
+ * written back then, when the file is closed for the last time, and
+ * at shutdown; a mapping only hands its dirty bit to the page cache
+ * page.  Writing back a page also writes the dirty, resident pages
+ * that follow it in the file, in one disk command. */
 
 #include "vm/vm.h"
+#ifdef VM
+#include <stdio.h>
+#include <string.h>
+#include <syscall-nr.h>
+#include "filesys/inode.h"
+#include "threads/malloc.h"
+#include "threads/mmu.h"
+#include "threads/synch.h"
+
 static bool page_cache_readahead (struct page *page, void *kva);
 static bool page_cache_writeback (struct page *page);
 static void page_cache_destroy (struct page *page);
 
+/* Most pages read by one readahead. */
+#define PAGE_CACHE_RA_MAX 8
+
 /* DO NOT MODIFY this struct */
 static const struct page_operations page_cache_op = {
 	.swap_in = page_cache_readahead,
@@ -13,38 +38,345 @@ static const struct page_operations page_cache_op = {
 	.type = VM_PAGE_CACHE,
 };
 
-tid_t page_cache_workerd;
+/* Writeback thread for msync (MS_ASYNC), and the ranges of pages it
+ * has been asked to write back. */
+static tid_t page_cache_workerd;
+static struct list writeback_queue;
+static struct lock writeback_lock;
+static struct semaphore writeback_sema;
+
+/* A range of an inode's pages to write back. */
+struct writeback_req {
+	struct list_elem elem;      /* Element in writeback_queue. */
+	struct inode *inode;        /* Reopened for the request. */
+	size_t first, cnt;          /* Page numbers. */
+};
+
+static void page_cache_kworkerd (void *aux);
+
+/* Statistics. */
+static unsigned long long load_cnt;        /* Reads from disk. */
+static unsigned long long readahead_cnt;   /* Pages read ahead by them. */
+static unsigned long long rw_hit_cnt;      /* read()/write() served here. */
+static unsigned long long writeback_cnt;   /* Pages written back. */
+static unsigned long long writeback_cluster_cnt;  /* Writes of more than
+                                                     one page. */
 
 /* The initializer of file vm */
+/* 쓰기는 eviction, 마지막 close, 종료, msync 때 한다.  worker thread는
+ * msync (MS_ASYNC)로 들어온 요청만 처리한다. */
 void
 pagecache_init (void) {
-	/* TODO: Create a worker daemon for page cache with page_cache_kworkerd */
+	list_init (&writeback_queue);
+	lock_init (&writeback_lock);
+	sema_init (&writeback_sema, 0);
+	page_cache_workerd = thread_create ("pagecache", PRI_DEFAULT,
+			page_cache_kworkerd, NULL);
 }
 
 /* Initialize the page cache */
 bool
-page_cache_initializer (struct page *page, enum vm_type type, void *kva) {
+page_cache_initializer (struct page *page, enum vm_type type UNUSED,
+		void *kva UNUSED) {
 	/* Set up the handler */
 	page->operations = &page_cache_op;
+	return true;
+}
+
+/* Adds a page cache page for page INDEX of INODE.  The caller holds
+ * INODE's page cache lock. */
+static struct page *
+cache_create (struct inode *inode, size_t index) {
+	struct page *page = malloc (sizeof *page);
+
+	if (page == NULL)
+		return NULL;
+	*page = (struct page) {
+		.type = VM_PAGE_CACHE,
+		.writable = true,
+		.page_cache = (struct page_cache) {
+			.inode = inode,
+			.index = index,
+		},
+	};
+	page_cache_initializer (page, VM_PAGE_CACHE, NULL);
+	if (!radix_insert (inode_page_cache (inode), index, page)) {
+		free (page);
+		return NULL;
+	}
+	return page;
+}
+
+/* Returns the page cache page for page INDEX of INODE, or a null
+ * pointer if there is none yet. */
+struct page *
+page_cache_lookup (struct inode *inode, size_t index) {
+	return radix_lookup (inode_page_cache (inode), index);
+}
+
+/* Returns the page cache page for page INDEX of INODE, adding one
+ * that is not in memory yet if there is none.  Returns a null
+ * pointer if memory is exhausted. */
+struct page *
+page_cache_get (struct inode *inode, size_t index) {
+	struct lock *lock = inode_page_cache_lock (inode);
+	struct page *page = page_cache_lookup (inode, index);
 
+	if (page == NULL) {
+		lock_acquire (lock);
+		page = page_cache_lookup (inode, index);
+		if (page == NULL)
+			page = cache_create (inode, index);
+		lock_release (lock);
+	}
+	return page;
+}
+
+/* Returns true if PAGE looks like part of a sequential read: it is
+ * the first page of its file, or the one before it is in memory. */
+static bool
+cache_sequential (struct page *page) {
+	struct page_cache *cache = &page->page_cache;
+	struct page *prev;
+
+	if (cache->index == 0)
+		return true;
+	prev = page_cache_lookup (cache->inode, cache->index - 1);
+	return prev != NULL && prev->frame != NULL;
 }
 
 /* Utilze the Swap in mechanism to implement readhead */
+/* PAGE를 읽는다.  순차적으로 읽히고 있으면 뒤따르는 페이지들도,
+ * 빈 프레임이 있는 만큼 같은 디스크 명령으로 미리 읽어 둔다.
+ * write()가 디스크에 쓰는 동안 읽지 않도록 inode의 page cache lock을
+ * 잡고 읽는다. */
 static bool
 page_cache_readahead (struct page *page, void *kva) {
+	struct page_cache *cache = &page->page_cache;
+	struct inode *inode = cache->inode;
+	struct lock *lock = inode_page_cache_lock (inode);
+	struct page *pages[PAGE_CACHE_RA_MAX];
+	struct frame *frames[PAGE_CACHE_RA_MAX];
+	void *kvas[PAGE_CACHE_RA_MAX];
+	off_t offset = (off_t) cache->index * PGSIZE;
+	off_t bytes_read;
+	size_t cnt = 1;
+
+	lock_acquire (lock);
+	pages[0] = page;
+	kvas[0] = kva;
+	if (page->advice == MADV_SEQUENTIAL
+			|| (page->advice != MADV_RANDOM && cache_sequential (page))) {
+		while (cnt < PAGE_CACHE_RA_MAX
+				&& offset + (off_t) (cnt * PGSIZE) < inode_length (inode)) {
+			struct page *next = page_cache_lookup (inode, cache->index + cnt);
+
+			if (next == NULL)
+				next = cache_create (inode, cache->index + cnt);
+			if (next == NULL || next->frame != NULL
+					|| (frames[cnt] = vm_frame_try_alloc ()) == NULL)
+				break;
+			if (!vm_frame_link (next, frames[cnt])) {
+				vm_frame_discard (frames[cnt]);
+				break;
+			}
+			pages[cnt] = next;
+			kvas[cnt] = frames[cnt]->kva;
+			cnt++;
+		}
+	}
+
+	bytes_read = inode_read_pages (inode, kvas, cnt, offset);
+	for (size_t i = 0; i < cnt; i++) {
+		off_t page_bytes = bytes_read - (off_t) (i * PGSIZE);
+
+		if (page_bytes < 0)
+			page_bytes = 0;
+		if (page_bytes > PGSIZE)
+			page_bytes = PGSIZE;
+		memset (kvas[i] + page_bytes, 0, PGSIZE - page_bytes);
+		pages[i]->page_cache.dirty = false;
+		if (i > 0)
+			vm_frame_unpin (frames[i]);
+	}
+	lock_release (lock);
+
+	load_cnt++;
+	readahead_cnt += cnt - 1;
+	return true;
+}
+
+/* Moves the dirty bits of the mappings of resident page cache PAGE
+ * into PAGE, where writes through a mapping show only in its dirty
+ * bit.  Returns true if PAGE is dirty, and marks it clean, as the
+ * caller is about to write it. */
+static bool
+cache_take_dirty (struct page *page) {
+	struct page_cache *cache = &page->page_cache;
+	bool dirty = cache->dirty;
+
+	for (struct page *map = page->frame->maps; map != NULL;
+			map = map->next_map) {
+		if (map->owner != NULL && pml4_is_dirty (page_pml4 (map), map->va)) {
+			dirty = true;
+			pml4_set_dirty (page_pml4 (map), map->va, false);
+		}
+	}
+	cache->dirty = false;
+	return dirty;
 }
 
 /* Utilze the Swap out mechanism to implement writeback */
+/* 프레임 락을 잡은 채로 불린다.  수정되었으면 파일에 쓰는데, 뒤이어
+ * 메모리에 있는 수정된 페이지들도 같이 한 번의 디스크 명령으로 쓴다.
+ * 이웃 페이지를 찾는 동안 tree가 바뀌지 않도록 inode의 page cache 락을
+ * 잡을 수 있을 때만 묶는다. */
 static bool
 page_cache_writeback (struct page *page) {
+	struct page_cache *cache = &page->page_cache;
+	struct lock *lock = inode_page_cache_lock (cache->inode);
+	const void *kvas[INODE_READ_PAGES_MAX];
+	bool held = lock_held_by_current_thread (lock);
+	bool locked = !held && lock_try_acquire (lock);
+	size_t cnt = 1;
+
+	if (!cache_take_dirty (page))
+		goto done;
+
+	kvas[0] = page->frame->kva;
+	while ((held || locked) && cnt < INODE_READ_PAGES_MAX) {
+		struct page *next = page_cache_lookup (cache->inode, cache->index + cnt);
+
+		if (next == NULL || next->frame == NULL || next->frame->pinned
+				|| !cache_take_dirty (next))
+			break;
+		kvas[cnt++] = next->frame->kva;
+	}
+	inode_write_pages (cache->inode, kvas, cnt,
+			(off_t) cache->index * PGSIZE);
+	writeback_cnt += cnt;
+	if (cnt > 1)
+		writeback_cluster_cnt++;
+
+done:
+	if (locked)
+		lock_release (lock);
+	return true;
 }
 
 /* Destory the page_cache. */
 static void
 page_cache_destroy (struct page *page) {
+	vm_frame_release (page);
+}
+
+/* Copies SIZE bytes between BUFFER and INODE's data at OFFSET, which
+ * must lie within one page, through the page cache if that page is
+ * in memory there.  Returns false, doing nothing, if it is not; the
+ * disk then holds its latest contents.  A writer must hold INODE's
+ * page cache lock, so that the page is not read in from disk while
+ * the caller writes there instead. */
+bool
+page_cache_rw (struct inode *inode, off_t offset, void *buffer, size_t size,
+		bool write) {
+	struct page *page = page_cache_lookup (inode, offset / PGSIZE);
+
+	if (page == NULL)
+		return false;
+	/* Before the copy, which eviction could otherwise write back
+	 * and forget. */
+	if (write)
+		page->page_cache.dirty = true;
+	if (!vm_page_copy (page, offset % PGSIZE, buffer, size, write))
+		return false;
+	rw_hit_cnt++;
+	return true;
+}
+
+/* Writes INODE's dirty page cache pages back to disk. */
+void
+page_cache_sync (struct inode *inode) {
+	struct radix *tree = inode_page_cache (inode);
+	struct page *page;
+	uint64_t index;
+
+	for (index = 0; (page = radix_next (tree, &index)) != NULL; index++)
+		vm_frame_flush (page);
+}
+
+/* Writes back the dirty ones among the CNT page cache pages of INODE
+ * that start at page FIRST.  If SYNC, returns when they have been
+ * written; otherwise the writeback thread writes them. */
+void
+page_cache_writeback_range (struct inode *inode, size_t first, size_t cnt,
+		bool sync) {
+	struct writeback_req *req;
+
+	if (!sync) {
+		req = malloc (sizeof *req);
+		if (req != NULL) {
+			req->inode = inode_reopen (inode);
+			req->first = first;
+			req->cnt = cnt;
+			lock_acquire (&writeback_lock);
+			list_push_back (&writeback_queue, &req->elem);
+			lock_release (&writeback_lock);
+			sema_up (&writeback_sema);
+			return;
+		}
+		/* Out of memory: write them back ourselves. */
+	}
+
+	for (size_t i = 0; i < cnt; i++) {
+		struct page *page = page_cache_lookup (inode, first + i);
+		if (page != NULL)
+			vm_frame_flush (page);
+	}
 }
 
 /* Worker thread for page cache */
 static void
-page_cache_kworkerd (void *aux) {
+page_cache_kworkerd (void *aux UNUSED) {
+	for (;;) {
+		struct writeback_req *req;
+
+		sema_down (&writeback_sema);
+		lock_acquire (&writeback_lock);
+		req = list_entry (list_pop_front (&writeback_queue),
+				struct writeback_req, elem);
+		lock_release (&writeback_lock);
+
+		page_cache_writeback_range (req->inode, req->first, req->cnt, true);
+		inode_close (req->inode);
+		free (req);
+	}
+}
+
+/* Frees INODE's page cache, which no mapping uses any more, writing
+ * dirty pages back first if WRITEBACK.  For the last close. */
+void
+page_cache_drop (struct inode *inode, bool writeback) {
+	struct radix *tree = inode_page_cache (inode);
+	struct page *page;
+	uint64_t index;
+
+	/* Eviction looks up neighbours under the lock. */
+	lock_acquire (inode_page_cache_lock (inode));
+	for (index = 0; (page = radix_next (tree, &index)) != NULL; index++) {
+		if (writeback)
+			vm_frame_flush (page);
+		radix_delete (tree, index);
+		vm_dealloc_page (page);
+	}
+	lock_release (inode_page_cache_lock (inode));
+}
+
+/* Prints page cache statistics. */
+void
+page_cache_print_stats (void) {
+	printf ("Page cache: %llu loads read %llu pages ahead, "
+			"%llu read/write hits, %llu writebacks (%llu clustered)\n",
+			load_cnt, readahead_cnt, rw_hit_cnt, writeback_cnt,
+			writeback_cluster_cnt);
 }
+#endif /* VM */
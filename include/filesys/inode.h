@@ -7,6 +7,10 @@
 
 struct bitmap;
 
+/* Most pages read by one inode_read_pages() or written by one
+ * inode_write_pages(). */
+#define INODE_READ_PAGES_MAX 16
+
 void inode_init (void);
 bool inode_create (disk_sector_t, off_t);
 struct inode *inode_open (disk_sector_t);
@@ -15,9 +19,20 @@ disk_sector_t inode_get_inumber (const struct inode *);
 void inode_close (struct inode *);
 void inode_remove (struct inode *);
 off_t inode_read_at (struct inode *, void *, off_t size, off_t offset);
+off_t inode_read_pages (struct inode *, void *const pages[], size_t cnt,
+		off_t offset);
 off_t inode_write_at (struct inode *, const void *, off_t size, off_t offset);
 void inode_deny_write (struct inode *);
 void inode_allow_write (struct inode *);
 off_t inode_length (const struct inode *);
+#ifdef VM
+struct lock;
+struct radix;
+off_t inode_write_pages (struct inode *, const void *const pages[],
+		size_t cnt, off_t offset);
+struct radix *inode_page_cache (struct inode *);
+struct lock *inode_page_cache_lock (struct inode *);
+void inode_sync_all (void);
+#endif
 
 #endif /* filesys/inode.h */
@@ -1,12 +1,31 @@
 #ifndef FILESYS_PAGE_CACHE_H
 #define FILESYS_PAGE_CACHE_H
 #include "vm/vm.h"
+#include "filesys/off_t.h"
 
 struct page;
+struct inode;
 enum vm_type;
 
-struct page_cache {};
+/* A page of a file's data, shared by read(), write() and every
+ * mapping of it.  Kept in its inode's page cache. */
+struct page_cache {
+	struct inode *inode;        /* File the page belongs to. */
+	uint32_t index;             /* Page number within the file. */
+	bool dirty;                 /* Written through write() or a mapping
+	                               since last read from or written to
+	                               disk. */
+};
 
-void page_cache_init (void);
+void pagecache_init (void);
 bool page_cache_initializer (struct page *page, enum vm_type type, void *kva);
+struct page *page_cache_get (struct inode *, size_t index);
+struct page *page_cache_lookup (struct inode *, size_t index);
+bool page_cache_rw (struct inode *, off_t offset, void *buffer, size_t size,
+		bool write);
+void page_cache_sync (struct inode *);
+void page_cache_writeback_range (struct inode *, size_t first, size_t cnt,
+		bool sync);
+void page_cache_drop (struct inode *, bool writeback);
+void page_cache_print_stats (void);
 #endif
@@ -0,0 +1,31 @@
+#ifndef __LIB_KERNEL_LZ4_H
+#define __LIB_KERNEL_LZ4_H
+
+/* LZ4 compression.
+ *
+ * Compresses a buffer into the LZ4 block format: a series of
+ * sequences, each a run of literal bytes followed by a copy of
+ * earlier output given as an offset and a length.  Matches are
+ * found through a hash table of recent 4-byte strings, so
+ * compression takes one pass and decompression is just copying.
+ * Zero-filled and repetitive data, which is most of what gets
+ * swapped, compresses very well.
+ *
+ * The compressor needs LZ4_WORKMEM_SIZE bytes of scratch space,
+ * which is too much for a kernel stack, so the caller provides
+ * it.  Neither function allocates memory. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define LZ4_HASH_BITS 12                         /* Hash table index bits. */
+#define LZ4_WORKMEM_SIZE ((1 << LZ4_HASH_BITS) * sizeof (uint16_t))
+#define LZ4_MAX_INPUT 65535                      /* Largest input. */
+#define LZ4_ERROR SIZE_MAX                       /* Corrupt input. */
+
+size_t lz4_compress (const void *src, size_t src_len,
+		void *dst, size_t dst_cap, void *wrkmem);
+size_t lz4_decompress (const void *src, size_t src_len,
+		void *dst, size_t dst_cap);
+
+#endif /* lib/kernel/lz4.h */
@@ -0,0 +1,57 @@
+#ifndef __LIB_KERNEL_RADIX_H
+#define __LIB_KERNEL_RADIX_H
+
+/* Radix tree.
+ *
+ * Maps integer keys of up to RADIX_KEY_BITS bits to non-null
+ * pointers.  The key is split into RADIX_LEVELS groups of
+ * RADIX_LEVEL_BITS bits, most significant first, and each group
+ * indexes one level of 128-slot nodes, much like the levels of an
+ * x86-64 page table.  Nodes are allocated on insertion and freed
+ * when they become empty; lookups never allocate.
+ *
+ * A lookup only follows pointers, and an insertion fills in a new
+ * node before linking it, so a lookup needs no lock against one
+ * concurrent writer.  Writers must be serialized by the caller.
+ *
+ * Iteration with radix_next() skips empty subtrees, so walking a
+ * sparse tree costs time in proportion to the populated part. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define RADIX_LEVEL_BITS 7                       /* Key bits per level. */
+#define RADIX_LEVELS 4                           /* Levels of nodes. */
+#define RADIX_KEY_BITS (RADIX_LEVEL_BITS * RADIX_LEVELS)
+#define RADIX_FANOUT (1 << RADIX_LEVEL_BITS)     /* Slots per node. */
+
+struct radix_node;
+
+/* Radix tree. */
+struct radix {
+	struct radix_node *root;    /* Top level node, or NULL if empty. */
+	size_t elem_cnt;            /* Number of values in the tree. */
+};
+
+/* Performs some operation on VALUE, stored under KEY, given
+ * auxiliary data AUX. */
+typedef void radix_action_func (uint64_t key, void *value, void *aux);
+
+/* Basic life cycle. */
+void radix_init (struct radix *);
+void radix_destroy (struct radix *, radix_action_func *, void *aux);
+
+/* Search, insertion, deletion. */
+void *radix_lookup (const struct radix *, uint64_t key);
+bool radix_insert (struct radix *, uint64_t key, void *value);
+void *radix_delete (struct radix *, uint64_t key);
+
+/* Iteration. */
+void *radix_next (const struct radix *, uint64_t *key);
+
+/* Information. */
+size_t radix_size (const struct radix *);
+bool radix_empty (const struct radix *);
+
+#endif /* lib/kernel/radix.h */
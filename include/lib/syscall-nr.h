@@ -36,6 +36,36 @@ enum {
 
 	SYS_MOUNT,
 	SYS_UMOUNT,
+
+	/* Extra for Project 3 */
+	SYS_MADVISE,                /* Advise on the use of memory. */
+	SYS_MSYNC,                  /* Write back a file mapping. */
+	SYS_MEMSTAT,                /* Report memory use. */
+	SYS_MEMLIMIT,               /* Limit resident memory. */
+};
+
+/* Advice for madvise(). */
+#define MADV_NORMAL 0               /* No special treatment. */
+#define MADV_RANDOM 1               /* Random access: no read-ahead. */
+#define MADV_SEQUENTIAL 2           /* Sequential access: read ahead far,
+                                       reclaim behind. */
+#define MADV_WILLNEED 3             /* Needed soon: read in now. */
+#define MADV_DONTNEED 4             /* Not needed soon: reclaim first. */
+
+/* Flags for msync(); exactly one is given. */
+#define MS_ASYNC 1                  /* Start writeback and return. */
+#define MS_SYNC 4                   /* Return once written back. */
+
+/* Memory use of the calling process, in pages, from memstat(). */
+struct memstat {
+	unsigned long rss;          /* Resident: ANON + FILE. */
+	unsigned long anon;         /* Resident anonymous pages. */
+	unsigned long file;         /* Resident pages of file mappings. */
+	unsigned long swap;         /* Anonymous pages swapped out. */
+	unsigned long wss;          /* Working set: pages accessed in the
+	                               last sampling interval. */
+	unsigned long limit;        /* Most resident pages, or 0 for no
+	                               limit; see memlimit(). */
 };
 
 #endif /* lib/syscall-nr.h */
@@ -2,27 +2,58 @@
 #define THREAD_MMU_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include "threads/pte.h"
 
 typedef bool pte_for_each_func (uint64_t *pte, void *va, void *aux);
 
+/* Pages of one pml4 whose cached translations are dropped together
+ * by tlb_batch_flush().  Past TLB_BATCH_MAX pages, the whole TLB of
+ * the address space is flushed instead of single pages. */
+#define TLB_BATCH_MAX 32
+struct tlb_batch {
+	uint64_t *pml4;                 /* Page table the changes are in. */
+	size_t cnt;                     /* Pages added so far. */
+	uint64_t va[TLB_BATCH_MAX];     /* The first TLB_BATCH_MAX of them. */
+};
+
+void tlb_batch_init (struct tlb_batch *, uint64_t *pml4);
+void tlb_batch_add (struct tlb_batch *, const void *va);
+void tlb_batch_flush (struct tlb_batch *);
+
 uint64_t *pml4e_walk (uint64_t *pml4, const uint64_t va, int create);
+uint64_t *pml4e_walk_huge (uint64_t *pml4, const uint64_t va, int create);
 uint64_t *pml4_create (void);
 bool pml4_for_each (uint64_t *, pte_for_each_func *, void *);
 void pml4_destroy (uint64_t *pml4);
+void pml4_reaper_init (void);
+bool pml4_reap_sync (void);
 void pml4_activate (uint64_t *pml4);
 void *pml4_get_page (uint64_t *pml4, const void *upage);
 bool pml4_set_page (uint64_t *pml4, void *upage, void *kpage, bool rw);
+bool pml4_set_huge_page (uint64_t *pml4, void *upage, void *kpage, bool rw);
 void pml4_clear_page (uint64_t *pml4, void *upage);
+void pml4_set_writable (uint64_t *pml4, void *upage, bool writable);
 bool pml4_is_dirty (uint64_t *pml4, const void *upage);
 void pml4_set_dirty (uint64_t *pml4, const void *upage, bool dirty);
 bool pml4_is_accessed (uint64_t *pml4, const void *upage);
 void pml4_set_accessed (uint64_t *pml4, const void *upage, bool accessed);
+void pml4_clear_page_batch (uint64_t *pml4, void *upage, struct tlb_batch *);
+void pml4_set_dirty_batch (uint64_t *pml4, const void *upage, bool dirty,
+		struct tlb_batch *);
+void pml4_set_accessed_batch (uint64_t *pml4, const void *upage,
+		bool accessed, struct tlb_batch *);
+
+/* Set by -nopcid. */
+extern bool pcid_disabled;
+void pcid_init (void);
+void mmu_print_stats (void);
 
 #define is_writable(pte) (*(pte) & PTE_W)
 #define is_user_pte(pte) (*(pte) & PTE_U)
 #define is_kern_pte(pte) (!is_user_pte (pte))
+#define is_huge_pte(pte) (*(pte) & PTE_PS)
 
 #define pte_get_paddr(pte) (pg_round_down(*(pte)))
 
@@ -172,6 +172,14 @@ struct thread {
 	struct supplemental_page_table spt;
 	void *stack_bottom;
 	void *rsp_stack;
+	size_t stack_limit;                 /* Most the stack grows to; kept
+	                                       across exec, inherited on fork. */
+	size_t mem_limit;                   /* Most resident pages, or 0; kept
+	                                       and inherited likewise. */
+	uint64_t reclaim_vpn;               /* Where reclaim of our own pages
+	                                       resumes. */
+	void *fault_around_next;            /* Page after the last window. */
+	size_t fault_around_pages;          /* Size of the last window. */
 #endif
 
 	/* Owned by thread.c. */
@@ -20,6 +20,15 @@
 #define PGSIZE  (1 << PGBITS)              /* Bytes in a page. */
 #define PGMASK  BITMASK(PGSHIFT, PGBITS)   /* Page offset bits (0:12). */
 
+/* Huge page offset (bits 0:21), mapped by a single PDE. */
+#define HPGBITS 21                         /* Number of huge page offset bits. */
+#define HPGSIZE (1 << HPGBITS)             /* Bytes in a huge page. */
+#define HPGMASK BITMASK(PGSHIFT, HPGBITS)  /* Huge page offset bits (0:21). */
+#define HPG_PAGES (HPGSIZE / PGSIZE)       /* Pages in a huge page. */
+
+/* Round down to nearest huge page boundary. */
+#define hpg_round_down(va) (void *) ((uint64_t) (va) & ~HPGMASK)
+
 /* Offset within a page. */
 #define pg_ofs(va) ((uint64_t) (va) & PGMASK)
 
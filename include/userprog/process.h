@@ -6,11 +6,13 @@
 
 
 
-// load segment에 사용되는 구조체
+// 페이지 하나가 파일의 어디에서 오는지.  페이지마다 저장하지 않고
+// 페이지가 속한 VMA와 주소에서 그때그때 계산한다 (vma_file_info()).
 struct file_info {
 	struct file *file;
 	off_t ofs;
 	size_t read_bytes;
+	struct vma *vma;        /* 페이지가 속한 영역. */
 };
 
 
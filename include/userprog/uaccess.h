@@ -0,0 +1,32 @@
+#ifndef USERPROG_UACCESS_H
+#define USERPROG_UACCESS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct intr_frame;
+
+/* Copies between kernel memory and user virtual memory.
+
+   The copies go straight at the user address.  A not-present
+   page is brought in by the page-fault handler as if the user had
+   touched it; a page that cannot be brought in, or a write to a
+   read-only page, stops the copy through the exception table
+   below instead of killing the kernel.  So callers need not
+   validate user buffers beforehand. */
+
+size_t copy_from_user (void *dst, const void *usrc, size_t size);
+size_t copy_to_user (void *udst, const void *src, size_t size);
+long strncpy_from_user (char *dst, const char *usrc, size_t size);
+
+/* Exception table entry: a fault at INSN, in kernel mode, resumes
+   at FIXUP. */
+struct exception_entry {
+	uint64_t insn;
+	uint64_t fixup;
+};
+
+bool fixup_exception (struct intr_frame *);
+
+#endif /* userprog/uaccess.h */
@@ -1,14 +1,17 @@
 #ifndef VM_ANON_H
 #define VM_ANON_H
 #include "vm/vm.h"
+#include "vm/swap.h"
 struct page;
 enum vm_type;
 
 struct anon_page {
-  int swap_sec;
+  swap_slot_t swap_slot;    /* Slot holding the page, or SWAP_SLOT_NONE. */
 };
 
 void vm_anon_init (void);
 bool anon_initializer (struct page *page, enum vm_type type, void *kva);
+void anon_share_swapped (struct page *dst, struct page *src);
+void anon_print_stats (void);
 
 #endif
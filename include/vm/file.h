@@ -4,9 +4,14 @@
 #include "vm/vm.h"
 
 struct page;
+struct file_info;
 enum vm_type;
 
 struct file_page {
+	struct vma *vma;            /* Mapping it belongs to, which says
+	                               which part of which file. */
+	struct page *cache;         /* Page cache page it maps, once it has
+	                               been claimed. */
 };
 
 void vm_file_init (void);
@@ -14,4 +19,12 @@ bool file_backed_initializer (struct page *page, enum vm_type type, void *kva);
 void *do_mmap(void *addr, size_t length, int writable,
 		struct file *file, off_t offset);
 void do_munmap (void *va);
+bool do_msync (void *addr, size_t length, int flags);
+bool file_claim_page (struct page *page);
+struct page *file_vma_page (struct vma *, void *va);
+struct vma *file_page_vma (struct page *page);
+void file_page_info (struct page *page, struct file_info *);
+bool file_read_around (struct page *page, void *kva,
+		const struct file_info *info);
+void file_print_stats (void);
 #endif
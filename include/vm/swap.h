@@ -0,0 +1,33 @@
+#ifndef VM_SWAP_H
+#define VM_SWAP_H
+#include <stdbool.h>
+#include <stddef.h>
+
+/* A page-sized slot on the swap disk. */
+typedef size_t swap_slot_t;
+#define SWAP_SLOT_NONE ((swap_slot_t) -1)
+
+/* Most pages moved by one swap_readv() or queued on a plug. */
+#define SWAP_IO_MAX 16
+
+/* Swap writes queued by swap_plug(). */
+struct swap_plug {
+	size_t cnt;
+	swap_slot_t slots[SWAP_IO_MAX];
+	const void *kvas[SWAP_IO_MAX];
+};
+
+void swap_init (void);
+swap_slot_t swap_alloc (void);
+swap_slot_t swap_dup (swap_slot_t);
+void swap_free (swap_slot_t);
+bool swap_tight (void);
+void swap_read (swap_slot_t, void *kva);
+void swap_readv (swap_slot_t, void *const kvas[], size_t cnt);
+void swap_write (swap_slot_t, const void *kva);
+void swap_writeback (swap_slot_t, const void *kva);
+void swap_plug (struct swap_plug *);
+void swap_unplug (struct swap_plug *);
+void swap_print_stats (void);
+
+#endif
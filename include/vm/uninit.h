@@ -9,16 +9,15 @@ typedef bool vm_initializer (struct page *, void *aux);
 
 /* Uninitlialized page. The type for implementing the
  * "Lazy loading". */
+/* The type the page becomes is kept in page->type, which also picks
+ * the initializer that turns it into that page object. */
 struct uninit_page {
 	/* Initiate the contets of the page */
 	vm_initializer *init;
-	enum vm_type type;
 	void *aux;
-	/* Initiate the struct page and maps the pa to the va */
-	bool (*page_initializer) (struct page *, enum vm_type, void *kva);
 };
 
 void uninit_new (struct page *page, void *va, vm_initializer *init,
-		enum vm_type type, void *aux,
-		bool (*initializer)(struct page *, enum vm_type, void *kva));
+		enum vm_type type, void *aux);
+bool uninit_transmute (struct page *page);
 #endif
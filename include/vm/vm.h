@@ -3,8 +3,10 @@
 #include <stdbool.h>
 #include "threads/palloc.h"
 
-#include <hash.h> 
+#include <list.h>
+#include <radix.h>
 #include "threads/vaddr.h"
+#include "vm/vma.h"
 
 enum vm_type {
 	/* page not initialized */
@@ -32,13 +34,11 @@ enum vm_type {
 #include "vm/uninit.h"
 #include "vm/anon.h"
 #include "vm/file.h"
-#include "hash.h"
-#ifdef EFILESYS
 #include "filesys/page_cache.h"
-#endif
 
 struct page_operations;
 struct thread;
+struct memstat;
 
 #define VM_TYPE(type) ((type) & 7)
 
@@ -63,10 +63,15 @@ struct page {
 
 
 	/* Your implementation */
-	uint8_t type;
-	bool is_loaded;
-	struct hash_elem hash_elem;
+	/* 페이지마다 하나씩 있으므로 malloc의 64바이트 블록에 들어가도록
+	 * 작게 유지한다 (아래 static assertion). */
+	struct thread *owner;           /* Owning process, or a null pointer
+	                                   for a page cache page. */
+	struct page *next_map;          /* Next page in frame's MAPS. */
+	uint8_t type;                   /* VM_* it is or is to become, with
+	                                   markers. */
 	bool writable;
+	uint8_t advice;                 /* MADV_*, from madvise(). */
 
 	/* Per-type data are binded into the union.
 	 * Each function automatically detects the current union */
@@ -74,23 +79,30 @@ struct page {
 		struct uninit_page uninit;
 		struct anon_page anon;
 		struct file_page file;
-#ifdef EFILESYS
 		struct page_cache page_cache;
-#endif
 	};
 };
 
+_Static_assert (sizeof (struct page) <= 64,
+		"struct page outgrew its malloc() block");
+
 
 /* The representation of "frame" */
+/* 유저 풀의 페이지마다 하나씩 있는 frame table의 원소. */
 struct frame {
-	void *kva;
-	struct page *page;
-	struct list_elem frame_elem;
+	void *kva;                      /* NULL while the frame is free. */
+	struct page *maps;              /* Pages mapping this frame (reverse map),
+	                                   linked through NEXT_MAP. */
+	int ref_cnt;                    /* Number of them; > 1 while shared
+	                                   copy-on-write after fork. */
+	bool pinned;                    /* Being filled; not to be evicted. */
+	bool referenced;                /* Accessed bits cleared by the working
+	                                   set sampler since the last sweep. */
+	bool ksm;                       /* Shared by same-page merging. */
+	uint64_t ksm_sum;               /* Hash of the contents when ksmd last
+	                                   looked, or 0. */
 };
 
-
-struct list frame_table;
-
 /* The function table for page operations.
  * This is one way of implementing "interface" in C.
  * Put the table of "method" into the struct's member, and
@@ -111,6 +123,19 @@ struct page_operations {
 #define destroy(page) \
 	if ((page)->operations->destroy) (page)->operations->destroy (page)
 
+/* Memory use of a process, in pages.  The counts follow its pages
+ * as they come and go from frames and swap; the working set is
+ * estimated by the sampler in vm.c. */
+struct vm_usage {
+	size_t anon;                   /* Resident anonymous pages. */
+	size_t file;                   /* Resident pages of file mappings. */
+	size_t swap;                   /* Anonymous pages swapped out. */
+	unsigned wss_pass;             /* Sampler pass that last saw a page
+	                                  of ours accessed... */
+	size_t wss_cnt;                /* ...and how many, so far. */
+	size_t wss;                    /* Count of the pass before. */
+};
+
 /* Representation of current process's memory space.
  * We don't want to force you to obey any specific design for this struct.
  * All designs up to you for this. */
@@ -119,7 +144,9 @@ struct page_operations {
 	 - 프로세스가 종료될 때 커널이 추가 페이지 테이블을 참조하여 어떤 리소스를 free시킬 것인지 결정
 */
 struct supplemental_page_table {
-	struct hash spt_table;
+	struct radix spt_table;        /* Virtual page number -> struct page. */
+	struct vma_tree vmas;          /* Memory mappings. */
+	struct vm_usage usage;         /* Memory use, for memstat(). */
 };
 
 
@@ -132,6 +159,49 @@ struct page *spt_find_page (struct supplemental_page_table *spt,
 		void *va);
 bool spt_insert_page (struct supplemental_page_table *spt, struct page *page);
 void spt_remove_page (struct supplemental_page_table *spt, struct page *page);
+bool spt_range_mapped (struct supplemental_page_table *spt, void *addr,
+		size_t length);
+uint64_t *page_pml4 (const struct page *);
+
+/* Most the user stack grows to by default (-stack=KB), and the gap
+ * left unmapped below that, so that overflowing the stack faults
+ * instead of running into other memory.  Both are reserved as one
+ * area at exec. */
+#define VM_STACK_LIMIT_DEFAULT 0x100000
+#define VM_STACK_GUARD (256 * PGSIZE)
+extern size_t vm_stack_limit;
+
+/* Back anonymous memory with 2 MB pages (-thp). */
+extern bool vm_thp_enabled;
+
+/* Merge identical anonymous pages in the background (-ksm). */
+extern bool vm_ksm_enabled;
+
+/* Print each process's memory use when it exits (-memstat). */
+extern bool vm_memstat_on_exit;
+
+/* Most resident pages of a new process, 0 for no limit
+ * (-memlimit=KB), and the least a limit may be: enough for one
+ * instruction's code, data and stack, with room to spare. */
+#define VM_MEM_LIMIT_MIN 16
+extern size_t vm_mem_limit;
+
+struct frame *vm_frame_try_alloc (void);
+void vm_frame_discard (struct frame *);
+bool vm_frame_map (struct page *, struct frame *);
+bool vm_frame_link (struct page *, struct frame *);
+void vm_frame_unpin (struct frame *);
+void vm_frame_flush (struct page *);
+bool vm_claim_shared (struct page *page, struct page *owner);
+bool vm_map_shared (struct page *page, struct page *owner);
+bool vm_page_copy (struct page *, size_t ofs, void *buffer, size_t size,
+		bool write);
+bool vm_page_maps_zero (struct page *);
+bool vm_madvise (void *addr, size_t length, int advice);
+void vm_account_swap (struct page *, int delta);
+void vm_memstat (struct thread *, struct memstat *);
+bool vm_set_mem_limit (size_t pages);
+void vm_print_stats (void);
 
 void vm_init (void);
 bool vm_try_handle_fault (struct intr_frame *f, void *addr, bool user,
@@ -143,11 +213,8 @@ bool vm_alloc_page_with_initializer (enum vm_type type, void *upage,
 		bool writable, vm_initializer *init, void *aux);
 void vm_dealloc_page (struct page *page);
 bool vm_claim_page (void *va);
+void vm_frame_release (struct page *page);
 enum vm_type page_get_type (struct page *page);
 
-unsigned page_hash(const struct hash_elem *p_, void *aux UNUSED);
-bool page_less(const struct hash_elem *a_, const struct hash_elem *b_, void *aux UNUSED);
-bool insert_page(struct hash *pages, struct page *p);
-bool delete_page(struct hash *pages, struct page *p);
 
 #endif  /* VM_VM_H */
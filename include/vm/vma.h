@@ -0,0 +1,64 @@
+#ifndef VM_VMA_H
+#define VM_VMA_H
+#include <stdbool.h>
+#include <stddef.h>
+#include "filesys/off_t.h"
+
+struct file;
+struct file_info;
+
+/* Kinds of area. */
+enum vma_type {
+	VMA_ANON,                   /* Only reserves its range (the stack). */
+	VMA_EXEC,                   /* Segment of the executable. */
+	VMA_MMAP                    /* mmap() of a file; pages map its page
+	                               cache and are made on first touch. */
+};
+
+/* Virtual memory area: a region of a process's address space, from
+ * START up to END, both page-aligned.  Where the pages of a file-backed
+ * area come from is kept here once, not in each page; a page's place
+ * in the file follows from its address (see vma_file_info()). */
+struct vma {
+	void *start;                /* First byte. */
+	void *end;                  /* Byte after the last. */
+	enum vma_type type;
+	struct file *file;          /* File, reopened for the VMA; null for
+	                               VMA_ANON. */
+	off_t offset;               /* Offset in FILE of START. */
+	size_t file_bytes;          /* Bytes of FILE mapped; the rest of
+	                               the area reads as zeros. */
+	bool writable;              /* Mapped writable? */
+
+	/* AVL tree, ordered by START, where each node also knows the
+	 * span of its subtree and the largest hole inside it. */
+	struct vma *left, *right;
+	int height;
+	void *sub_start, *sub_end;  /* Lowest start, highest end. */
+	size_t sub_gap;             /* Largest gap between two areas. */
+};
+
+/* A process's VMAs, which never overlap. */
+struct vma_tree {
+	struct vma *root;
+	size_t cnt;
+};
+
+void vma_tree_init (struct vma_tree *);
+bool vma_tree_copy (struct vma_tree *dst, const struct vma_tree *src);
+void vma_tree_destroy (struct vma_tree *);
+
+struct vma *vma_create (struct vma_tree *, void *start, void *end,
+		enum vma_type, struct file *, off_t offset, bool writable);
+void vma_destroy (struct vma_tree *, struct vma *);
+
+struct vma *vma_find (const struct vma_tree *, const void *addr);
+bool vma_overlaps (const struct vma_tree *, const void *start,
+		const void *end);
+struct vma *vma_first (const struct vma_tree *);
+struct vma *vma_next (const struct vma_tree *, const struct vma *);
+void vma_file_info (struct vma *, void *va, struct file_info *);
+void *vma_find_gap (const struct vma_tree *, size_t length, void *lo,
+		void *hi);
+
+#endif /* vm/vma.h */
@@ -0,0 +1,15 @@
+#ifndef VM_ZSWAP_H
+#define VM_ZSWAP_H
+#include <stdbool.h>
+#include "vm/swap.h"
+
+/* Keep swapped-out pages compressed in memory (off with -nozswap). */
+extern bool zswap_disabled;
+
+void zswap_init (void);
+bool zswap_store (swap_slot_t, const void *kva);
+bool zswap_load (swap_slot_t, void *kva);
+void zswap_invalidate (swap_slot_t);
+void zswap_print_stats (void);
+
+#endif
@@ -0,0 +1,210 @@
+/* LZ4 compression.
+
+   See lz4.h for basic information. */
+
+#include "lz4.h"
+#include <stdbool.h>
+#include <string.h>
+#include "../debug.h"
+
+#define MIN_MATCH 4         /* Shortest match worth encoding. */
+#define LAST_LITERALS 5     /* The last bytes are always literals. */
+#define MF_LIMIT 12         /* No match starts this close to the end. */
+#define RUN_MASK 15         /* Length nibble meaning "more follows". */
+
+/* Returns the 4 bytes at P as an integer. */
+static inline uint32_t
+read32 (const uint8_t *p) {
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+/* Returns the hash table index for the 4 bytes SEQ. */
+static inline unsigned
+hash32 (uint32_t seq) {
+	return (seq * 2654435761U) >> (32 - LZ4_HASH_BITS);
+}
+
+/* Returns the number of bytes emit_length() writes for the part
+   of N beyond a full nibble. */
+static inline size_t
+length_bytes (size_t n) {
+	return n >= RUN_MASK ? (n - RUN_MASK) / 255 + 1 : 0;
+}
+
+/* Writes the part of N beyond a full nibble at OP, as a run of
+   255s and a final byte less than 255, and returns the byte after
+   it. */
+static uint8_t *
+emit_length (uint8_t *op, size_t n) {
+	if (n < RUN_MASK)
+		return op;
+	for (n -= RUN_MASK; n >= 255; n -= 255)
+		*op++ = 255;
+	*op++ = n;
+	return op;
+}
+
+/* Writes one sequence at OP: the LIT_LEN literals at LIT, then,
+   unless MATCH_LEN is 0, a match of MATCH_LEN bytes OFFSET bytes
+   back.  Returns the byte after it, or a null pointer if it would
+   not fit before OEND. */
+static uint8_t *
+emit_sequence (uint8_t *op, uint8_t *oend, const uint8_t *lit,
+		size_t lit_len, size_t offset, size_t match_len) {
+	size_t ml = match_len > 0 ? match_len - MIN_MATCH : 0;
+	size_t need = 1 + length_bytes (lit_len) + lit_len;
+
+	if (match_len > 0)
+		need += 2 + length_bytes (ml);
+	if (need > (size_t) (oend - op))
+		return NULL;
+
+	*op++ = ((lit_len < RUN_MASK ? lit_len : RUN_MASK) << 4)
+		| (ml < RUN_MASK ? ml : RUN_MASK);
+	op = emit_length (op, lit_len);
+	memcpy (op, lit, lit_len);
+	op += lit_len;
+	if (match_len > 0) {
+		*op++ = offset & 0xff;
+		*op++ = offset >> 8;
+		op = emit_length (op, ml);
+	}
+	return op;
+}
+
+/* Compresses the SRC_LEN bytes at SRC into DST, which has room
+   for DST_CAP bytes, using the LZ4_WORKMEM_SIZE bytes at WRKMEM
+   as scratch space.  Returns the compressed size, or 0 if it
+   would exceed DST_CAP.  SRC_LEN may be at most LZ4_MAX_INPUT. */
+size_t
+lz4_compress (const void *src_, size_t src_len,
+		void *dst_, size_t dst_cap, void *wrkmem) {
+	const uint8_t *src = src_;
+	const uint8_t *end = src + src_len;
+	const uint8_t *ip = src;
+	const uint8_t *anchor = src;
+	uint8_t *dst = dst_;
+	uint8_t *op = dst;
+	uint8_t *oend = dst + dst_cap;
+	uint16_t *table = wrkmem;
+
+	ASSERT (src_len <= LZ4_MAX_INPUT);
+
+	memset (table, 0, LZ4_WORKMEM_SIZE);
+	if (src_len > MF_LIMIT) {
+		const uint8_t *mf_limit = end - MF_LIMIT;
+		const uint8_t *match_limit = end - LAST_LITERALS;
+		unsigned misses = 0;
+
+		while (ip < mf_limit) {
+			uint32_t seq = read32 (ip);
+			unsigned h = hash32 (seq);
+			const uint8_t *ref = src + table[h];
+			size_t len;
+
+			table[h] = ip - src;
+			if (ref >= ip || read32 (ref) != seq) {
+				/* Step faster through data that does not
+				   compress. */
+				ip += 1 + (misses++ >> 6);
+				continue;
+			}
+			misses = 0;
+
+			/* Extend the match backward over pending literals,
+			   then forward as far as it goes. */
+			while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+				ip--;
+				ref--;
+			}
+			len = MIN_MATCH;
+			while (ip + len < match_limit && ip[len] == ref[len])
+				len++;
+
+			op = emit_sequence (op, oend, anchor, ip - anchor, ip - ref, len);
+			if (op == NULL)
+				return 0;
+			ip += len;
+			anchor = ip;
+
+			/* Index a position inside the match so that the
+			   next one can refer back into it. */
+			if (ip < mf_limit)
+				table[hash32 (read32 (ip - 2))] = ip - 2 - src;
+		}
+	}
+
+	op = emit_sequence (op, oend, anchor, end - anchor, 0, 0);
+	return op != NULL ? (size_t) (op - dst) : 0;
+}
+
+/* Reads the part of a length beyond a full nibble from *IP, which
+   must stay below IEND, adding it to *N.  Returns false if the
+   input ends first. */
+static bool
+read_length (const uint8_t **ip, const uint8_t *iend, size_t *n) {
+	uint8_t b;
+
+	do {
+		if (*ip >= iend)
+			return false;
+		b = *(*ip)++;
+		*n += b;
+	} while (b == 255);
+	return true;
+}
+
+/* Decompresses the SRC_LEN bytes of LZ4 data at SRC into DST,
+   which has room for DST_CAP bytes.  Returns the decompressed
+   size, or LZ4_ERROR if the data is corrupt or does not fit.
+   Never reads or writes outside the two buffers. */
+size_t
+lz4_decompress (const void *src, size_t src_len, void *dst_, size_t dst_cap) {
+	const uint8_t *ip = src;
+	const uint8_t *iend = ip + src_len;
+	uint8_t *dst = dst_;
+	uint8_t *op = dst;
+	uint8_t *oend = dst + dst_cap;
+
+	while (ip < iend) {
+		unsigned token = *ip++;
+		size_t lit_len = token >> 4;
+		size_t match_len = token & RUN_MASK;
+		size_t offset;
+		const uint8_t *ref;
+
+		if (lit_len == RUN_MASK && !read_length (&ip, iend, &lit_len))
+			return LZ4_ERROR;
+		if (lit_len > (size_t) (iend - ip) || lit_len > (size_t) (oend - op))
+			return LZ4_ERROR;
+		memcpy (op, ip, lit_len);
+		ip += lit_len;
+		op += lit_len;
+
+		/* The last sequence has no match. */
+		if (ip == iend)
+			break;
+
+		if (iend - ip < 2)
+			return LZ4_ERROR;
+		offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+		if (match_len == RUN_MASK && !read_length (&ip, iend, &match_len))
+			return LZ4_ERROR;
+		match_len += MIN_MATCH;
+		if (offset == 0 || offset > (size_t) (op - dst)
+				|| match_len > (size_t) (oend - op))
+			return LZ4_ERROR;
+
+		/* The source may overlap what is being written, which
+		   is how runs are encoded, so copy forward bytewise. */
+		ref = op - offset;
+		if (offset >= match_len)
+			memcpy (op, ref, match_len);
+		else
+			for (size_t i = 0; i < match_len; i++)
+				op[i] = ref[i];
+		op += match_len;
+	}
+	return op - dst;
+}
@@ -0,0 +1,221 @@
+/* Radix tree.
+
+   See radix.h for basic information. */
+
+#include "radix.h"
+#include <string.h>
+#include "../debug.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+
+/* One level of the tree: child nodes, or values at the bottom
+   level.  128 pointers make a node exactly 1 kB. */
+struct radix_node {
+	void *slots[RADIX_FANOUT];
+};
+
+/* Returns the slot that KEY goes through at LEVEL (0 is the
+   root). */
+static inline unsigned
+slot_index (uint64_t key, int level) {
+	int shift = (RADIX_LEVELS - 1 - level) * RADIX_LEVEL_BITS;
+	return (key >> shift) & (RADIX_FANOUT - 1);
+}
+
+/* Returns a new node with no children, or a null pointer if
+   memory is exhausted. */
+static struct radix_node *
+node_create (void) {
+	struct radix_node *n = malloc (sizeof *n);
+	if (n != NULL)
+		memset (n, 0, sizeof *n);
+	return n;
+}
+
+/* Returns true if no slot of N is in use. */
+static bool
+node_empty (const struct radix_node *n) {
+	for (int i = 0; i < RADIX_FANOUT; i++)
+		if (n->slots[i] != NULL)
+			return false;
+	return true;
+}
+
+/* Initializes R as an empty radix tree. */
+void
+radix_init (struct radix *r) {
+	r->root = NULL;
+	r->elem_cnt = 0;
+}
+
+/* Frees the subtree N at LEVEL, whose keys start at BASE,
+   calling DESTRUCTOR on each value first. */
+static void
+destroy_node (struct radix_node *n, int level, uint64_t base,
+		radix_action_func *destructor, void *aux) {
+	int shift = (RADIX_LEVELS - 1 - level) * RADIX_LEVEL_BITS;
+
+	for (int i = 0; i < RADIX_FANOUT; i++) {
+		void *slot = n->slots[i];
+		uint64_t key = base | ((uint64_t) i << shift);
+
+		if (slot == NULL)
+			continue;
+		if (level < RADIX_LEVELS - 1)
+			destroy_node (slot, level + 1, key, destructor, aux);
+		else if (destructor != NULL)
+			destructor (key, slot, aux);
+	}
+	free (n);
+}
+
+/* Destroys radix tree R, freeing its nodes.
+
+   If DESTRUCTOR is non-null, then it is first called for each
+   value, in ascending key order, with auxiliary data AUX.
+   DESTRUCTOR may deallocate the value, but must not modify R. */
+void
+radix_destroy (struct radix *r, radix_action_func *destructor, void *aux) {
+	if (r->root != NULL)
+		destroy_node (r->root, 0, 0, destructor, aux);
+	radix_init (r);
+}
+
+/* Returns the value stored under KEY in R, or a null pointer if
+   there is none.  Never allocates. */
+void *
+radix_lookup (const struct radix *r, uint64_t key) {
+	const struct radix_node *n = r->root;
+
+	ASSERT (key < (1ULL << RADIX_KEY_BITS));
+
+	for (int level = 0; n != NULL && level < RADIX_LEVELS - 1; level++)
+		n = n->slots[slot_index (key, level)];
+	return n != NULL ? n->slots[slot_index (key, RADIX_LEVELS - 1)] : NULL;
+}
+
+/* Stores VALUE, which must not be null, under KEY in R.  Returns
+   false if KEY is already in use or memory is exhausted. */
+bool
+radix_insert (struct radix *r, uint64_t key, void *value) {
+	struct radix_node **np = &r->root;
+	void **slot;
+
+	ASSERT (value != NULL);
+	ASSERT (key < (1ULL << RADIX_KEY_BITS));
+
+	for (int level = 0; ; level++) {
+		if (*np == NULL) {
+			struct radix_node *n = node_create ();
+			if (n == NULL)
+				return false;
+			/* Make the zeroed node visible only once it is ready. */
+			barrier ();
+			*np = n;
+		}
+		if (level == RADIX_LEVELS - 1)
+			break;
+		np = (struct radix_node **) &(*np)->slots[slot_index (key, level)];
+	}
+
+	slot = &(*np)->slots[slot_index (key, RADIX_LEVELS - 1)];
+	if (*slot != NULL)
+		return false;
+	*slot = value;
+	r->elem_cnt++;
+	return true;
+}
+
+/* Removes the value stored under KEY from R and returns it, or
+   returns a null pointer if there is none.  Nodes left empty are
+   freed, so this must not run concurrently with a lookup. */
+void *
+radix_delete (struct radix *r, uint64_t key) {
+	struct radix_node *path[RADIX_LEVELS];
+	struct radix_node *n = r->root;
+	void **slot;
+	void *value;
+	int level;
+
+	ASSERT (key < (1ULL << RADIX_KEY_BITS));
+
+	for (level = 0; level < RADIX_LEVELS; level++) {
+		if (n == NULL)
+			return NULL;
+		path[level] = n;
+		if (level < RADIX_LEVELS - 1)
+			n = n->slots[slot_index (key, level)];
+	}
+
+	slot = &path[RADIX_LEVELS - 1]->slots[slot_index (key, RADIX_LEVELS - 1)];
+	value = *slot;
+	if (value == NULL)
+		return NULL;
+	*slot = NULL;
+	r->elem_cnt--;
+
+	/* Free the nodes that became empty, bottom up. */
+	for (level = RADIX_LEVELS - 1; level >= 0 && node_empty (path[level]);
+			level--) {
+		if (level == 0)
+			r->root = NULL;
+		else
+			path[level - 1]->slots[slot_index (key, level - 1)] = NULL;
+		free (path[level]);
+	}
+	return value;
+}
+
+/* Returns the first value at or after *KEY in the subtree N at
+   LEVEL, whose keys start at BASE, and stores its key in *KEY. */
+static void *
+next_in_node (const struct radix_node *n, int level, uint64_t base,
+		uint64_t *key) {
+	int shift = (RADIX_LEVELS - 1 - level) * RADIX_LEVEL_BITS;
+	int first = base <= *key ? slot_index (*key, level) : 0;
+
+	for (int i = first; i < RADIX_FANOUT; i++) {
+		void *slot = n->slots[i];
+		uint64_t slot_base = base | ((uint64_t) i << shift);
+
+		if (slot == NULL)
+			continue;
+		if (level == RADIX_LEVELS - 1) {
+			*key = slot_base;
+			return slot;
+		}
+		slot = next_in_node (slot, level + 1, slot_base, key);
+		if (slot != NULL)
+			return slot;
+	}
+	return NULL;
+}
+
+/* Finds the value with the smallest key greater than or equal to
+   *KEY in R.  Stores that key in *KEY and returns the value, or
+   returns a null pointer if there is none.  To visit every value:
+
+      uint64_t key;
+      void *value;
+      for (key = 0; (value = radix_next (r, &key)) != NULL; key++)
+         ...do something with value...
+
+   Deleting the value just returned is allowed. */
+void *
+radix_next (const struct radix *r, uint64_t *key) {
+	if (r->root == NULL || *key >= (1ULL << RADIX_KEY_BITS))
+		return NULL;
+	return next_in_node (r->root, 0, 0, key);
+}
+
+/* Returns the number of values in R. */
+size_t
+radix_size (const struct radix *r) {
+	return r->elem_cnt;
+}
+
+/* Returns true if R contains no values, false otherwise. */
+bool
+radix_empty (const struct radix *r) {
+	return r->elem_cnt == 0;
+}
@@ -2,4 +2,6 @@ lib/kernel_SRC  = lib/kernel/debug.c	# Debug helpers.
 lib/kernel_SRC += lib/kernel/list.c	# Doubly-linked lists.
 lib/kernel_SRC += lib/kernel/bitmap.c	# Bitmaps.
 lib/kernel_SRC += lib/kernel/hash.c	# Hash tables.
+lib/kernel_SRC += lib/kernel/radix.c	# Radix trees.
+lib/kernel_SRC += lib/kernel/lz4.c	# LZ4 compression.
 lib/kernel_SRC += lib/kernel/console.c	# printf(), putchar().
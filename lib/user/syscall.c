@@ -156,6 +156,26 @@ munmap (void *addr) {
 	syscall1 (SYS_MUNMAP, addr);
 }
 
+int
+madvise (void *addr, size_t length, int advice) {
+	return syscall3 (SYS_MADVISE, addr, length, advice);
+}
+
+int
+msync (void *addr, size_t length, int flags) {
+	return syscall3 (SYS_MSYNC, addr, length, flags);
+}
+
+int
+memstat (struct memstat *stat) {
+	return syscall1 (SYS_MEMSTAT, stat);
+}
+
+int
+memlimit (unsigned long pages) {
+	return syscall1 (SYS_MEMLIMIT, pages);
+}
+
 bool
 chdir (const char *dir) {
 	return syscall1 (SYS_CHDIR, dir);
@@ -0,0 +1,38 @@
+/* Forks, then has the child read() a file into a buffer it still
+   shares copy-on-write with its parent.  The kernel writes that
+   buffer on the child's behalf, so it must take the same
+   write-protection fault a user store would and copy the page,
+   leaving the parent's buffer untouched. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+#include "tests/vm/sample.inc"
+
+static char buf[sizeof sample];
+
+void
+test_main (void)
+{
+  pid_t child;
+  size_t i;
+
+  memset (buf, 'P', sizeof buf);
+  child = fork ("child");
+  if (child == 0)
+    {
+      int handle;
+
+      CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+      CHECK (read (handle, buf, sizeof sample - 1) == sizeof sample - 1,
+             "read \"sample.txt\" into shared page");
+      if (memcmp (buf, sample, sizeof sample - 1))
+        fail ("child read wrong data");
+      exit (0x42);
+    }
+  CHECK (wait (child) == 0x42, "wait for child");
+  for (i = 0; i < sizeof buf; i++)
+    if (buf[i] != 'P')
+      fail ("parent's byte %zu changed to %d", i, buf[i]);
+}
@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(cow-read) begin
+(cow-read) open "sample.txt"
+(cow-read) read "sample.txt" into shared page
+(cow-read) wait for child
+(cow-read) end
+EOF
+pass;
@@ -0,0 +1,37 @@
+/* Holds the process to a memory limit, touches four times as much
+   memory, and checks that it stayed near the limit without losing
+   any data. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define LIMIT 64
+#define PAGES (4 * LIMIT)
+
+static char buf[PAGES * 4096];
+
+void
+test_main (void)
+{
+  struct memstat stat;
+  size_t i;
+
+  CHECK (memlimit (1) == -1, "memlimit too small");
+  CHECK (memlimit (LIMIT) == 0, "memlimit %d pages", LIMIT);
+  for (i = 0; i < PAGES; i++)
+    buf[i * 4096] = i;
+
+  CHECK (memstat (&stat) == 0, "memstat");
+  if (stat.limit != LIMIT)
+    fail ("limit is %lu pages", stat.limit);
+  if (stat.rss > LIMIT + 8)
+    fail ("rss is %lu pages, over the limit", stat.rss);
+
+  for (i = 0; i < PAGES; i++)
+    if (buf[i * 4096] != (char) i)
+      fail ("page %zu lost its data", i);
+  msg ("data intact");
+
+  CHECK (memlimit (0) == 0, "lift the limit");
+}
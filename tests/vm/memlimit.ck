@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(memlimit) begin
+(memlimit) memlimit too small
+(memlimit) memlimit 64 pages
+(memlimit) memstat
+(memlimit) data intact
+(memlimit) lift the limit
+(memlimit) end
+EOF
+pass;
@@ -0,0 +1,47 @@
+/* Touches anonymous memory and a file mapping and checks that
+   memstat() counts them as resident, each of its own kind. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ACTUAL ((void *) 0x10000000)
+#define PAGES 32
+
+static char buf[PAGES * 4096];
+
+void
+test_main (void)
+{
+  struct memstat before, after;
+  int handle;
+  char *map;
+  size_t i;
+
+  CHECK (memstat (&before) == 0, "memstat");
+  for (i = 0; i < PAGES; i++)
+    buf[i * 4096] = 1;
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK ((map = mmap (ACTUAL, 4096, 0, handle, 0)) != MAP_FAILED,
+         "mmap \"sample.txt\"");
+  if (map[0] == '\0')
+    fail ("mapping reads zero");
+
+  CHECK (memstat (&after) == 0, "memstat after touching memory");
+  if (after.rss != after.anon + after.file)
+    fail ("rss %lu is not anon %lu + file %lu",
+          after.rss, after.anon, after.file);
+  if (after.anon < before.anon + PAGES)
+    fail ("anon grew from %lu to %lu pages after touching %d",
+          before.anon, after.anon, PAGES);
+  if (after.file != before.file + 1)
+    fail ("file went from %lu to %lu pages after reading a mapping",
+          before.file, after.file);
+
+  munmap (map);
+  CHECK (memstat (&after) == 0, "memstat after munmap");
+  if (after.file != before.file)
+    fail ("file still %lu pages after munmap", after.file);
+  close (handle);
+}
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(memstat) begin
+(memstat) memstat
+(memstat) open "sample.txt"
+(memstat) mmap "sample.txt"
+(memstat) memstat after touching memory
+(memstat) memstat after munmap
+(memstat) end
+EOF
+pass;
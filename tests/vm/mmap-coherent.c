@@ -0,0 +1,41 @@
+/* Maps a file and, while it stays mapped, checks that read()
+   sees what is written through the mapping and that the mapping
+   sees what write() writes, as they share the page cache. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ACTUAL ((void *) 0x10000000)
+
+void
+test_main (void)
+{
+  int handle;
+  char *map;
+  char buf[1024];
+  size_t len = strlen (sample);
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK ((map = mmap (ACTUAL, 4096, 1, handle, 0)) != MAP_FAILED,
+         "mmap \"sample.txt\"");
+
+  /* Through the mapping, then read(). */
+  map[0] = 'X';
+  seek (handle, 0);
+  CHECK (read (handle, buf, len) == (int) len, "read \"sample.txt\"");
+  if (buf[0] != 'X' || memcmp (buf + 1, sample + 1, len - 1))
+    fail ("read() does not see the write through the mapping");
+
+  /* Through write(), then the mapping. */
+  seek (handle, 1);
+  CHECK (write (handle, "YZ", 2) == 2, "write \"sample.txt\"");
+  if (memcmp (map, "XYZ", 3) || memcmp (map + 3, sample + 3, len - 3))
+    fail ("mapping does not see write()");
+
+  munmap (map);
+  close (handle);
+  msg ("coherent");
+}
@@ -0,0 +1,49 @@
+/* Gives advice on a file mapping, writes through it, and flushes
+   it with msync() in both modes, checking that bad arguments are
+   refused and that the data survives DONTNEED. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ACTUAL ((void *) 0x10000000)
+
+void
+test_main (void)
+{
+  int handle;
+  char *map;
+  char buf[1024];
+  size_t len = strlen (sample);
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK ((map = mmap (ACTUAL, 4096, 1, handle, 0)) != MAP_FAILED,
+         "mmap \"sample.txt\"");
+
+  CHECK (madvise (map, 4096, MADV_SEQUENTIAL) == 0, "madvise sequential");
+  CHECK (madvise (map, 4096, MADV_WILLNEED) == 0, "madvise willneed");
+  CHECK (madvise (map, 4096, 99) == -1, "madvise with bad advice");
+  CHECK (madvise (map + 4096, 4096, MADV_RANDOM) == -1,
+         "madvise on unmapped memory");
+
+  map[0] = 'X';
+  CHECK (msync (map, 4096, MS_SYNC) == 0, "msync sync");
+  map[1] = 'Y';
+  CHECK (msync (map, 4096, MS_ASYNC) == 0, "msync async");
+  CHECK (msync (map, 4096, MS_SYNC | MS_ASYNC) == -1, "msync with bad flags");
+  CHECK (msync (map + 1, 4096, MS_SYNC) == -1, "msync on unaligned address");
+
+  /* The mapping lets go of its frame; the data must stay. */
+  CHECK (madvise (map, 4096, MADV_DONTNEED) == 0, "madvise dontneed");
+  if (memcmp (map, "XY", 2) || memcmp (map + 2, sample + 2, len - 2))
+    fail ("mapping lost data after MADV_DONTNEED");
+
+  munmap (map);
+  seek (handle, 0);
+  CHECK (read (handle, buf, len) == (int) len, "read \"sample.txt\"");
+  if (memcmp (buf, "XY", 2) || memcmp (buf + 2, sample + 2, len - 2))
+    fail ("read data differs from data written through the mapping");
+  close (handle);
+}
@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-msync) begin
+(mmap-msync) open "sample.txt"
+(mmap-msync) mmap "sample.txt"
+(mmap-msync) madvise sequential
+(mmap-msync) madvise willneed
+(mmap-msync) madvise with bad advice
+(mmap-msync) madvise on unmapped memory
+(mmap-msync) msync sync
+(mmap-msync) msync async
+(mmap-msync) msync with bad flags
+(mmap-msync) msync on unaligned address
+(mmap-msync) madvise dontneed
+(mmap-msync) read "sample.txt"
+(mmap-msync) end
+EOF
+pass;
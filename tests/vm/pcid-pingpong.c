@@ -0,0 +1,48 @@
+/* Runs two processes side by side that keep being switched
+   while each one rewrites and checks its own copy of the same
+   pages.  Translations cached for one address space must never
+   be used by the other, whether or not the TLB is flushed on a
+   switch.  The "TLB:" line printed at shutdown, with and without
+   -nopcid, gives the cost of a switch. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define PAGE_CNT 16
+#define ROUND_CNT 200000
+
+static char buf[PAGE_CNT * PAGE_SIZE];
+
+static void
+pingpong (char tag)
+{
+  int round, i;
+
+  for (i = 0; i < PAGE_CNT; i++)
+    buf[i * PAGE_SIZE] = tag;
+  for (round = 1; round <= ROUND_CNT; round++)
+    for (i = 0; i < PAGE_CNT; i++)
+      {
+        char *p = &buf[i * PAGE_SIZE];
+        char want = tag ^ ((round - 1) & 0x7f);
+        if (*p != want)
+          fail ("page %d holds %d in round %d, expected %d",
+                i, *p, round, want);
+        *p = tag ^ (round & 0x7f);
+      }
+}
+
+void
+test_main (void)
+{
+  pid_t child = fork ("child");
+  if (child == 0)
+    {
+      pingpong ('C');
+      exit (0x42);
+    }
+  pingpong ('P');
+  CHECK (wait (child) == 0x42, "wait for child");
+}
@@ -0,0 +1,10 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(pcid-pingpong) begin
+(pcid-pingpong) wait for child
+(pcid-pingpong) end
+EOF
+pass;
@@ -0,0 +1,15 @@
+/* Touches an object 1.5 MB deep on the stack, past the 1 MB the
+   stack may grow to and into the guard gap below it.  The process
+   must be terminated with -1 exit code. */
+
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  volatile char stk_obj[1536 * 1024];
+
+  stk_obj[0] = 1;
+  fail ("stack grew past its limit: read back %d", stk_obj[0]);
+}
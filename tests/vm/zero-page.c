@@ -0,0 +1,78 @@
+/* Reads a large zero-filled array in BSS, which the kernel may back
+   with a single shared zero page, then writes to some of its pages,
+   directly and through read(), and checks that every other page
+   still reads as zeros, in this process and in a forked child. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+#include "tests/vm/sample.inc"
+
+#define PAGE_SIZE 4096
+#define PAGE_CNT 256
+
+static char buf[PAGE_CNT * PAGE_SIZE];
+
+/* Checks that page PAGE of BUF is all zeros. */
+static void
+check_zero (size_t page)
+{
+  size_t i;
+
+  for (i = 0; i < PAGE_SIZE; i++)
+    if (buf[page * PAGE_SIZE + i] != 0)
+      fail ("byte %zu of page %zu is %d", i, page, buf[page * PAGE_SIZE + i]);
+}
+
+/* Checks every page of BUF: page 3 holds "sample.txt", every 16th
+   page starts with its number, and the rest are zeros. */
+static void
+check_buf (void)
+{
+  size_t page;
+
+  for (page = 0; page < PAGE_CNT; page++)
+    if (page == 3)
+      {
+        if (memcmp (buf + page * PAGE_SIZE, sample, sizeof sample - 1))
+          fail ("page 3 does not hold sample.txt");
+      }
+    else if (page % 16 == 0)
+      {
+        if (buf[page * PAGE_SIZE] != (char) (page / 16 + 1))
+          fail ("page %zu lost its write", page);
+      }
+    else
+      check_zero (page);
+}
+
+void
+test_main (void)
+{
+  int handle;
+  pid_t child;
+  size_t page;
+
+  for (page = 0; page < PAGE_CNT; page++)
+    check_zero (page);
+  msg ("read zeros");
+
+  for (page = 0; page < PAGE_CNT; page += 16)
+    buf[page * PAGE_SIZE] = page / 16 + 1;
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK (read (handle, buf + 3 * PAGE_SIZE, sizeof sample - 1)
+         == sizeof sample - 1, "read \"sample.txt\" into zero page");
+  check_buf ();
+  msg ("wrote some pages");
+
+  child = fork ("child");
+  if (child == 0)
+    {
+      check_buf ();
+      buf[5 * PAGE_SIZE] = 'C';
+      exit (0x42);
+    }
+  CHECK (wait (child) == 0x42, "wait for child");
+  check_buf ();
+}
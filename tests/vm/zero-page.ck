@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(zero-page) begin
+(zero-page) read zeros
+(zero-page) open "sample.txt"
+(zero-page) read "sample.txt" into zero page
+(zero-page) wrote some pages
+(zero-page) wait for child
+(zero-page) end
+EOF
+pass;
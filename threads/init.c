@@ -3,6 +3,7 @@
 #include <debug.h>
 #include <limits.h>
 #include <random.h>
+#include <round.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -31,6 +32,7 @@
 #include "tests/threads/tests.h"
 #ifdef VM
 #include "vm/vm.h"
+#include "vm/zswap.h"
 #endif
 #ifdef FILESYS
 #include "devices/disk.h"
@@ -112,6 +114,9 @@ main (void) {
 	thread_start ();
 	serial_init_queue ();
 	timer_calibrate ();
+#ifdef USERPROG
+	pml4_reaper_init ();
+#endif
 
 #ifdef FILESYS
 	/* Initialize file system. */
@@ -160,19 +165,33 @@ paging_init (uint64_t mem_end) {
 	extern char start, _end_kernel_text;
 	// Maps physical address [0 ~ mem_end] to
 	//   [LOADER_KERN_BASE ~ LOADER_KERN_BASE + mem_end].
-	for (uint64_t pa = 0; pa < mem_end; pa += PGSIZE) {
+	for (uint64_t pa = 0; pa < mem_end; ) {
 		uint64_t va = (uint64_t) ptov(pa);
 
+		/* Whole 2 MB chunks outside the read-only kernel text are
+		 * mapped by a single PDE, which saves the page tables and
+		 * lets one TLB entry cover 512 pages of kernel memory. */
+		if ((pa & HPGMASK) == 0 && pa + HPGSIZE <= mem_end
+				&& (va + HPGSIZE <= (uint64_t) &start
+					|| va >= (uint64_t) &_end_kernel_text)) {
+			if ((pte = pml4e_walk_huge (pml4, va, 1)) != NULL)
+				*pte = pa | PTE_PS | PTE_P | PTE_W;
+			pa += HPGSIZE;
+			continue;
+		}
+
 		perm = PTE_P | PTE_W;
 		if ((uint64_t) &start <= va && va < (uint64_t) &_end_kernel_text)
 			perm &= ~PTE_W;
 
 		if ((pte = pml4e_walk (pml4, va, 1)) != NULL)
 			*pte = pa | perm;
+		pa += PGSIZE;
 	}
 
 	// reload cr3
 	pml4_activate(0);
+	pcid_init ();
 }
 
 /* Breaks the kernel command line into words and returns them as
@@ -229,11 +248,31 @@ parse_options (char **argv) {
 			random_init (atoi (value));
 		else if (!strcmp (name, "-mlfqs"))
 			thread_mlfqs = true;
+		else if (!strcmp (name, "-nopcid"))
+			pcid_disabled = true;
 #ifdef USERPROG
 		else if (!strcmp (name, "-ul"))
 			user_page_limit = atoi (value);
 		else if (!strcmp (name, "-threads-tests"))
 			thread_tests = true;
+#endif
+#ifdef VM
+		else if (!strcmp (name, "-thp"))
+			vm_thp_enabled = true;
+		else if (!strcmp (name, "-ksm"))
+			vm_ksm_enabled = true;
+		else if (!strcmp (name, "-nozswap"))
+			zswap_disabled = true;
+		else if (!strcmp (name, "-stack"))
+			vm_stack_limit = ROUND_UP ((size_t) atoi (value) * 1024, PGSIZE);
+		else if (!strcmp (name, "-memstat"))
+			vm_memstat_on_exit = true;
+		else if (!strcmp (name, "-memlimit")) {
+			vm_mem_limit = DIV_ROUND_UP ((size_t) atoi (value) * 1024, PGSIZE);
+			if (vm_mem_limit != 0 && vm_mem_limit < VM_MEM_LIMIT_MIN)
+				PANIC ("-memlimit must be at least %d kB",
+						VM_MEM_LIMIT_MIN * PGSIZE / 1024);
+		}
 #endif
 		else
 			PANIC ("unknown option `%s' (use -h for help)", name);
@@ -341,8 +380,17 @@ usage (void) {
 			"  -f                 Format file system disk during startup.\n"
 			"  -rs=SEED           Set random number seed to SEED.\n"
 			"  -mlfqs             Use multi-level feedback queue scheduler.\n"
+			"  -nopcid            Flush the whole TLB on every process switch.\n"
 #ifdef USERPROG
 			"  -ul=COUNT          Limit user memory to COUNT pages.\n"
+#endif
+#ifdef VM
+			"  -thp               Back anonymous memory with 2 MB pages.\n"
+			"  -ksm               Merge identical anonymous pages in the background.\n"
+			"  -nozswap           Swap straight to disk, not compressing in memory.\n"
+			"  -stack=KB          Let user stacks grow to KB kB (default 1024).\n"
+			"  -memstat           Print each process's memory use at exit.\n"
+			"  -memlimit=KB       Keep each process to KB kB of resident memory.\n"
 #endif
 			);
 	power_off ();
@@ -369,6 +417,9 @@ static void
 print_stats (void) {
 	timer_print_stats ();
 	thread_print_stats ();
+	palloc_print_stats ();
+	malloc_print_stats ();
+	mmu_print_stats ();
 #ifdef FILESYS
 	disk_print_stats ();
 #endif
@@ -377,4 +428,7 @@ print_stats (void) {
 #ifdef USERPROG
 	exception_print_stats ();
 #endif
+#ifdef VM
+	vm_print_stats ();
+#endif
 }
@@ -2,9 +2,11 @@
 #include <debug.h>
 #include <list.h>
 #include <round.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/interrupt.h"
 #include "threads/palloc.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
@@ -32,7 +34,14 @@
    because they're too big to fit in a single page with a
    descriptor.  We handle those by allocating contiguous pages
    with the page allocator and sticking the allocation size at
-   the beginning of the allocated block's arena header. */
+   the beginning of the allocated block's arena header.
+
+   Every descriptor counts its allocations, frees, live blocks and
+   the arenas it currently holds; malloc_print_stats() dumps them
+   at shutdown.  When built with MALLOC_DEBUG, each block is also
+   prefixed with a small tag that records the call site of the
+   malloc(), and live bytes are aggregated per call site so that
+   the top consumers can be reported as well. */
 
 /* Descriptor. */
 struct desc {
@@ -40,8 +49,20 @@ struct desc {
 	size_t blocks_per_arena;    /* Number of blocks in an arena. */
 	struct list free_list;      /* List of free blocks. */
 	struct lock lock;           /* Lock. */
+
+	/* Statistics, protected by LOCK. */
+	unsigned long long alloc_cnt; /* Blocks handed out. */
+	unsigned long long free_cnt;  /* Blocks given back. */
+	size_t live_cnt;            /* Blocks currently in use. */
+	size_t arena_cnt;           /* Arenas currently held. */
+	size_t peak_arena_cnt;      /* High-water mark of ARENA_CNT. */
 };
 
+/* Statistics for big blocks, which have no descriptor.  Updated
+   with interrupts off, as the big-block paths take no lock. */
+static unsigned long long big_alloc_cnt, big_free_cnt;
+static size_t big_live_cnt, big_live_pages;
+
 /* Magic number for detecting arena corruption. */
 #define ARENA_MAGIC 0x9a548eed
 
@@ -64,6 +85,29 @@ static size_t desc_cnt;         /* Number of descriptors. */
 static struct arena *block_to_arena (struct block *);
 static struct block *arena_to_block (struct arena *, size_t idx);
 
+#ifdef MALLOC_DEBUG
+/* Prefix of every block in MALLOC_DEBUG builds.  Its size keeps
+   the returned pointer aligned the same way the block is. */
+struct trace_tag {
+	void *caller;               /* Return address of malloc()'s caller. */
+	size_t size;                /* Bytes requested. */
+};
+
+/* Live allocations charged to one call site. */
+struct call_site {
+	void *caller;               /* Null if the slot is unused. */
+	size_t live_cnt;            /* Live blocks. */
+	size_t live_bytes;          /* Live requested bytes. */
+};
+
+#define CALL_SITE_CNT 128       /* Must be a power of 2. */
+static struct call_site call_sites[CALL_SITE_CNT];
+static struct lock call_site_lock;
+
+static void *trace_alloc (void *block, size_t size, void *caller);
+static void *trace_free (void *p);
+#endif
+
 /* Initializes the malloc() descriptors. */
 void
 malloc_init (void) {
@@ -77,20 +121,44 @@ malloc_init (void) {
 		list_init (&d->free_list);
 		lock_init (&d->lock);
 	}
+#ifdef MALLOC_DEBUG
+	lock_init (&call_site_lock);
+#endif
+}
+
+static void *do_malloc (size_t size);
+
+/* Allocates SIZE bytes on behalf of CALLER, which is only used by
+   MALLOC_DEBUG builds. */
+static void *
+malloc_from (size_t size, void *caller UNUSED) {
+	/* A null pointer satisfies a request for 0 bytes. */
+	if (size == 0)
+		return NULL;
+
+#ifdef MALLOC_DEBUG
+	void *block = do_malloc (size + sizeof (struct trace_tag));
+	return block != NULL ? trace_alloc (block, size, caller) : NULL;
+#else
+	return do_malloc (size);
+#endif
 }
 
 /* Obtains and returns a new block of at least SIZE bytes.
    Returns a null pointer if memory is not available. */
 void *
 malloc (size_t size) {
+	return malloc_from (size, __builtin_return_address (0));
+}
+
+/* Does the work of malloc() for SIZE bytes, including any
+   MALLOC_DEBUG tag. */
+static void *
+do_malloc (size_t size) {
 	struct desc *d;
 	struct block *b;
 	struct arena *a;
 
-	/* A null pointer satisfies a request for 0 bytes. */
-	if (size == 0)
-		return NULL;
-
 	/* Find the smallest descriptor that satisfies a SIZE-byte
 	   request. */
 	for (d = descs; d < descs + desc_cnt; d++)
@@ -109,6 +177,12 @@ malloc (size_t size) {
 		a->magic = ARENA_MAGIC;
 		a->desc = NULL;
 		a->free_cnt = page_cnt;
+
+		enum intr_level old_level = intr_disable ();
+		big_alloc_cnt++;
+		big_live_cnt++;
+		big_live_pages += page_cnt;
+		intr_set_level (old_level);
 		return a + 1;
 	}
 
@@ -133,12 +207,16 @@ malloc (size_t size) {
 			struct block *b = arena_to_block (a, i);
 			list_push_back (&d->free_list, &b->free_elem);
 		}
+		if (++d->arena_cnt > d->peak_arena_cnt)
+			d->peak_arena_cnt = d->arena_cnt;
 	}
 
 	/* Get a block from free list and return it. */
 	b = list_entry (list_pop_front (&d->free_list), struct block, free_elem);
 	a = block_to_arena (b);
 	a->free_cnt--;
+	d->alloc_cnt++;
+	d->live_cnt++;
 	lock_release (&d->lock);
 	return b;
 }
@@ -156,7 +234,7 @@ calloc (size_t a, size_t b) {
 		return NULL;
 
 	/* Allocate and zero memory. */
-	p = malloc (size);
+	p = malloc_from (size, __builtin_return_address (0));
 	if (p != NULL)
 		memset (p, 0, size);
 
@@ -173,6 +251,18 @@ block_size (void *block) {
 	return d != NULL ? d->block_size : PGSIZE * a->free_cnt - pg_ofs (block);
 }
 
+/* Returns the number of bytes the caller may use in P, which was
+   returned by malloc(). */
+static size_t
+usable_size (void *p) {
+#ifdef MALLOC_DEBUG
+	struct trace_tag *tag = (struct trace_tag *) p - 1;
+	return block_size (tag) - sizeof *tag;
+#else
+	return block_size (p);
+#endif
+}
+
 /* Attempts to resize OLD_BLOCK to NEW_SIZE bytes, possibly
    moving it in the process.
    If successful, returns the new block; on failure, returns a
@@ -185,9 +275,9 @@ realloc (void *old_block, size_t new_size) {
 		free (old_block);
 		return NULL;
 	} else {
-		void *new_block = malloc (new_size);
+		void *new_block = malloc_from (new_size, __builtin_return_address (0));
 		if (old_block != NULL && new_block != NULL) {
-			size_t old_size = block_size (old_block);
+			size_t old_size = usable_size (old_block);
 			size_t min_size = new_size < old_size ? new_size : old_size;
 			memcpy (new_block, old_block, min_size);
 			free (old_block);
@@ -201,6 +291,9 @@ realloc (void *old_block, size_t new_size) {
 void
 free (void *p) {
 	if (p != NULL) {
+#ifdef MALLOC_DEBUG
+		p = trace_free (p);
+#endif
 		struct block *b = p;
 		struct arena *a = block_to_arena (b);
 		struct desc *d = a->desc;
@@ -217,6 +310,8 @@ free (void *p) {
 
 			/* Add block to free list. */
 			list_push_front (&d->free_list, &b->free_elem);
+			d->free_cnt++;
+			d->live_cnt--;
 
 			/* If the arena is now entirely unused, free it. */
 			if (++a->free_cnt >= d->blocks_per_arena) {
@@ -228,11 +323,18 @@ free (void *p) {
 					list_remove (&b->free_elem);
 				}
 				palloc_free_page (a);
+				d->arena_cnt--;
 			}
 
 			lock_release (&d->lock);
 		} else {
 			/* It's a big block.  Free its pages. */
+			enum intr_level old_level = intr_disable ();
+			big_free_cnt++;
+			big_live_cnt--;
+			big_live_pages -= a->free_cnt;
+			intr_set_level (old_level);
+
 			palloc_free_multiple (a, a->free_cnt);
 			return;
 		}
@@ -266,3 +368,122 @@ arena_to_block (struct arena *a, size_t idx) {
 			+ sizeof *a
 			+ idx * a->desc->block_size);
 }
+
+/* Returns the number of bytes of memory that malloc() sets aside
+   for a SIZE-byte request, which is at least SIZE. */
+size_t
+malloc_block_size (size_t size) {
+	struct desc *d;
+
+#ifdef MALLOC_DEBUG
+	size += sizeof (struct trace_tag);
+#endif
+	for (d = descs; d < descs + desc_cnt; d++)
+		if (d->block_size >= size)
+			return d->block_size;
+	return DIV_ROUND_UP (size + sizeof (struct arena), PGSIZE) * PGSIZE;
+}
+
+/* Prints per-descriptor allocation statistics and, in MALLOC_DEBUG
+   builds, the call sites holding the most live memory. */
+void
+malloc_print_stats (void) {
+	struct desc *d;
+
+	printf ("Malloc:\n");
+	for (d = descs; d < descs + desc_cnt; d++) {
+		if (d->alloc_cnt == 0)
+			continue;
+		printf ("  %4zu B: %llu allocs, %llu frees, %zu live (%zu bytes), "
+				"%zu arenas (peak %zu)\n",
+				d->block_size, d->alloc_cnt, d->free_cnt, d->live_cnt,
+				d->live_cnt * d->block_size, d->arena_cnt, d->peak_arena_cnt);
+	}
+	printf ("   big: %llu allocs, %llu frees, %zu live (%zu pages)\n",
+			big_alloc_cnt, big_free_cnt, big_live_cnt, big_live_pages);
+
+#ifdef MALLOC_DEBUG
+	/* Selection sort of the few top entries; the table is small. */
+	enum { TOP_CNT = 10 };
+	bool shown[CALL_SITE_CNT];
+	int i, j;
+
+	memset (shown, 0, sizeof shown);
+	printf ("Top live malloc() call sites:\n");
+	for (i = 0; i < TOP_CNT; i++) {
+		int best = -1;
+		for (j = 0; j < CALL_SITE_CNT; j++)
+			if (!shown[j] && call_sites[j].live_cnt > 0
+					&& (best < 0
+						|| call_sites[j].live_bytes > call_sites[best].live_bytes))
+				best = j;
+		if (best < 0)
+			break;
+		shown[best] = true;
+		printf ("  %p: %zu bytes in %zu blocks\n", call_sites[best].caller,
+				call_sites[best].live_bytes, call_sites[best].live_cnt);
+	}
+#endif
+}
+
+#ifdef MALLOC_DEBUG
+/* Returns the call-site slot for CALLER, claiming a free one if
+   CREATE is true, or a null pointer if there is none.
+   CALL_SITE_LOCK must be held. */
+static struct call_site *
+lookup_call_site (void *caller, bool create) {
+	size_t idx = ((uintptr_t) caller >> 2) & (CALL_SITE_CNT - 1);
+	size_t i;
+
+	for (i = 0; i < CALL_SITE_CNT; i++) {
+		struct call_site *cs = &call_sites[(idx + i) & (CALL_SITE_CNT - 1)];
+		if (cs->caller == caller)
+			return cs;
+		if (cs->caller == NULL) {
+			if (!create)
+				return NULL;
+			cs->caller = caller;
+			return cs;
+		}
+	}
+	return NULL;
+}
+
+/* Tags BLOCK, freshly obtained for a SIZE-byte request from
+   CALLER, and returns the pointer to hand out. */
+static void *
+trace_alloc (void *block, size_t size, void *caller) {
+	struct trace_tag *tag = block;
+	struct call_site *cs;
+
+	tag->caller = caller;
+	tag->size = size;
+
+	lock_acquire (&call_site_lock);
+	cs = lookup_call_site (caller, true);
+	if (cs != NULL) {
+		cs->live_cnt++;
+		cs->live_bytes += size;
+	}
+	lock_release (&call_site_lock);
+	return tag + 1;
+}
+
+/* Uncharges P, returned by malloc(), from its call site and
+   returns the underlying block. */
+static void *
+trace_free (void *p) {
+	struct trace_tag *tag = (struct trace_tag *) p - 1;
+	struct call_site *cs;
+
+	lock_acquire (&call_site_lock);
+	cs = lookup_call_site (tag->caller, false);
+	if (cs != NULL) {
+		ASSERT (cs->live_cnt > 0);
+		cs->live_cnt--;
+		cs->live_bytes -= tag->size;
+	}
+	lock_release (&call_site_lock);
+	return tag;
+}
+#endif
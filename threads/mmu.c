@@ -1,13 +1,111 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <string.h>
+#include <stdio.h>
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/pte.h"
 #include "threads/palloc.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
 #include "threads/mmu.h"
 #include "intrinsic.h"
 
+/* ---- Page-table page cache ---- */
+
+/* Page-table pages freed by pml4 teardown are kept, zeroed, on a
+ * free list and handed to the next walk or pml4_create() that
+ * needs one, instead of going back through palloc.  The list is
+ * linked through the first word of each page.  Pintos has a single
+ * CPU, so one list with interrupts off stands in for per-CPU
+ * lists. */
+#define PT_CACHE_MAX 64
+
+static uint64_t *pt_cache;              /* Head of the free list. */
+static size_t pt_cache_cnt;             /* Pages on it. */
+static unsigned long long pt_cache_hit_cnt;   /* pt_alloc()s it served. */
+
+/* Returns a zeroed page for a page table, from the cache if it
+ * has one.  FLAGS is passed to palloc_get_page() otherwise. */
+static void *
+pt_alloc (enum palloc_flags flags) {
+	enum intr_level old_level = intr_disable ();
+	uint64_t *page = pt_cache;
+	if (page != NULL) {
+		pt_cache = (uint64_t *) page[0];
+		pt_cache_cnt--;
+		pt_cache_hit_cnt++;
+	}
+	intr_set_level (old_level);
+
+	if (page == NULL)
+		return palloc_get_page (flags | PAL_ZERO);
+	page[0] = 0;
+	return page;
+}
+
+/* Gives back page-table page PAGE. */
+static void
+pt_free (void *page) {
+	enum intr_level old_level = intr_disable ();
+	bool keep = pt_cache_cnt < PT_CACHE_MAX;
+	if (keep)
+		pt_cache_cnt++;
+	intr_set_level (old_level);
+
+	if (!keep) {
+		palloc_free_page (page);
+		return;
+	}
+	memset (page, 0, PGSIZE);
+	old_level = intr_disable ();
+	((uint64_t *) page)[0] = (uint64_t) pt_cache;
+	pt_cache = page;
+	intr_set_level (old_level);
+}
+
+/* Returns every cached page-table page to palloc.  Returns true
+ * if there was any. */
+static bool
+pt_cache_drain (void) {
+	bool drained = false;
+
+	for (;;) {
+		enum intr_level old_level = intr_disable ();
+		uint64_t *page = pt_cache;
+		if (page != NULL) {
+			pt_cache = (uint64_t *) page[0];
+			pt_cache_cnt--;
+		}
+		intr_set_level (old_level);
+
+		if (page == NULL)
+			return drained;
+		palloc_free_page (page);
+		drained = true;
+	}
+}
+
+/* Replaces the 2 MB mapping in *PDE by a page table holding the
+ * 512 equivalent 4 kB mappings, so that one page of the huge page
+ * can be remapped, protected or unmapped on its own.  The
+ * translation of every address stays the same, so no TLB flush is
+ * needed until one of the new PTEs is changed.  FLAGS is passed to
+ * pt_alloc(); returns false if the allocation fails. */
+static bool
+pde_split (uint64_t *pde, enum palloc_flags flags) {
+	uint64_t *pt = pt_alloc (flags);
+	if (pt == NULL)
+		return false;
+
+	uint64_t pa = HPTE_ADDR (*pde);
+	uint64_t perm = *pde & PTE_FLAGS & ~(uint64_t) PTE_PS;
+	for (unsigned i = 0; i < PGSIZE / sizeof (uint64_t *); i++)
+		pt[i] = (pa + i * PGSIZE) | perm;
+	*pde = vtop (pt) | PTE_U | PTE_W | PTE_P;
+	return true;
+}
+
 static uint64_t *
 pgdir_walk (uint64_t *pdp, const uint64_t va, int create) {
 	int idx = PDX (va);
@@ -15,13 +113,20 @@ pgdir_walk (uint64_t *pdp, const uint64_t va, int create) {
 		uint64_t *pte = (uint64_t *) pdp[idx];
 		if (!((uint64_t) pte & PTE_P)) {
 			if (create) {
-				uint64_t *new_page = palloc_get_page (PAL_ZERO);
+				uint64_t *new_page = pt_alloc (0);
 				if (new_page)
 					pdp[idx] = vtop (new_page) | PTE_U | PTE_W | PTE_P;
 				else
 					return NULL;
 			} else
 				return NULL;
+		} else if (pdp[idx] & PTE_PS) {
+			/* VA lies in a 2 MB page.  Plain lookups get the PDE
+			 * itself; callers that install a PTE split it first. */
+			if (!create)
+				return &pdp[idx];
+			if (!pde_split (&pdp[idx], 0))
+				return NULL;
 		}
 		return (uint64_t *) ptov (PTE_ADDR (pdp[idx]) + 8 * PTX (va));
 	}
@@ -37,7 +142,7 @@ pdpe_walk (uint64_t *pdpe, const uint64_t va, int create) {
 		uint64_t *pde = (uint64_t *) pdpe[idx];
 		if (!((uint64_t) pde & PTE_P)) {
 			if (create) {
-				uint64_t *new_page = palloc_get_page (PAL_ZERO);
+				uint64_t *new_page = pt_alloc (0);
 				if (new_page) {
 					pdpe[idx] = vtop (new_page) | PTE_U | PTE_W | PTE_P;
 					allocated = 1;
@@ -49,7 +154,7 @@ pdpe_walk (uint64_t *pdpe, const uint64_t va, int create) {
 		pte = pgdir_walk (ptov (PTE_ADDR (pdpe[idx])), va, create);
 	}
 	if (pte == NULL && allocated) {
-		palloc_free_page ((void *) ptov (PTE_ADDR (pdpe[idx])));
+		pt_free ((void *) ptov (PTE_ADDR (pdpe[idx])));
 		pdpe[idx] = 0;
 	}
 	return pte;
@@ -64,7 +169,10 @@ pdpe_walk (uint64_t *pdpe, const uint64_t va, int create) {
  * 
  * 페이지 맵 수준 4, pml4에서 가상 주소 VADDR에 대한 페이지 테이블 항목의 주소를 반환합니다.PML4E에 VADDR에 대한 페이지 테이블이 없는 경우 동작은 CREATE에 따라 달라집니다. CREATE가 참일 경우, 새 페이지 테이블이 작성되고 해당 테이블로의 포인터가 반환됩니다.
  * 그렇지 않으면 null 포인터가 반환됩니다.
- * 
+ *
+ * If VADDR is covered by a 2 MB page, a lookup (CREATE false)
+ * returns its PDE, which has PTE_PS set; CREATE splits the huge
+ * page and returns the new PTE.
  * */
 uint64_t *
 pml4e_walk (uint64_t *pml4e, const uint64_t va, int create) {
@@ -75,7 +183,7 @@ pml4e_walk (uint64_t *pml4e, const uint64_t va, int create) {
 		uint64_t *pdpe = (uint64_t *) pml4e[idx];
 		if (!((uint64_t) pdpe & PTE_P)) {
 			if (create) {
-				uint64_t *new_page = palloc_get_page (PAL_ZERO);
+				uint64_t *new_page = pt_alloc (0);
 				if (new_page) {
 					pml4e[idx] = vtop (new_page) | PTE_U | PTE_W | PTE_P;
 					allocated = 1;
@@ -87,19 +195,56 @@ pml4e_walk (uint64_t *pml4e, const uint64_t va, int create) {
 		pte = pdpe_walk (ptov (PTE_ADDR (pml4e[idx])), va, create);
 	}
 	if (pte == NULL && allocated) {
-		palloc_free_page ((void *) ptov (PTE_ADDR (pml4e[idx])));
+		pt_free ((void *) ptov (PTE_ADDR (pml4e[idx])));
 		pml4e[idx] = 0;
 	}
 	return pte;
 }
 
+/* Returns the address of the page directory entry for virtual
+ * address VADDR in PML4, allocating the upper levels if CREATE is
+ * true.  Returns a null pointer if they are missing and CREATE is
+ * false, or if allocation fails. */
+uint64_t *
+pml4e_walk_huge (uint64_t *pml4, const uint64_t va, int create) {
+	uint64_t *table = pml4;
+	unsigned idx[2] = { PML4 (va), PDPE (va) };
+
+	for (int level = 0; level < 2; level++) {
+		uint64_t *e = &table[idx[level]];
+		if (!(*e & PTE_P)) {
+			if (!create)
+				return NULL;
+			uint64_t *new_page = pt_alloc (0);
+			if (new_page == NULL)
+				return NULL;
+			*e = vtop (new_page) | PTE_U | PTE_W | PTE_P;
+		}
+		table = ptov (PTE_ADDR (*e));
+	}
+	return &table[PDX (va)];
+}
+
+/* Like pml4e_walk (PML4, VA, false), but if VA lies in a 2 MB
+ * page, splits it first so the returned PTE maps VA alone.
+ * Panics if the kernel pool cannot supply the page table. */
+static uint64_t *
+pml4e_walk_split (uint64_t *pml4, const uint64_t va) {
+	uint64_t *pte = pml4e_walk (pml4, va, false);
+	if (pte != NULL && (*pte & PTE_PS)) {
+		pde_split (pte, PAL_ASSERT);
+		pte = pml4e_walk (pml4, va, false);
+	}
+	return pte;
+}
+
 /* Creates a new page map level 4 (pml4) has mappings for kernel
  * virtual addresses, but none for user virtual addresses.
  * Returns the new page directory, or a null pointer if memory
  * allocation fails. */
 uint64_t *
 pml4_create (void) {
-	uint64_t *pml4 = palloc_get_page (0);
+	uint64_t *pml4 = pt_alloc (0);
 	if (pml4)
 		memcpy (pml4, base_pml4, PGSIZE);
 	return pml4;
@@ -127,10 +272,18 @@ pgdir_for_each (uint64_t *pdp, pte_for_each_func *func, void *aux,
 		unsigned pml4_index, unsigned pdp_index) {
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
 		uint64_t *pte = ptov((uint64_t *) pdp[i]);
-		if (((uint64_t) pte) & PTE_P)
-			if (!pt_for_each ((uint64_t *) PTE_ADDR (pte), func, aux,
+		if (((uint64_t) pte) & PTE_P) {
+			if (pdp[i] & PTE_PS) {
+				/* A 2 MB page is visited once, through its PDE. */
+				void *va = (void *) (((uint64_t) pml4_index << PML4SHIFT) |
+									 ((uint64_t) pdp_index << PDPESHIFT) |
+									 ((uint64_t) i << PDXSHIFT));
+				if (!func (&pdp[i], va, aux))
+					return false;
+			} else if (!pt_for_each ((uint64_t *) PTE_ADDR (pte), func, aux,
 					pml4_index, pdp_index, i))
 				return false;
+		}
 	}
 	return true;
 }
@@ -148,7 +301,8 @@ pdp_for_each (uint64_t *pdp,
 	return true;
 }
 
-/* Apply FUNC to each available pte entries including kernel's. */
+/* Apply FUNC to each available pte entries including kernel's.
+ * A 2 MB page is passed once, as its PDE (with PTE_PS set). */
 bool
 // 	if (!pml4_for_each (parent->pml4, duplicate_pte, parent))
 pml4_for_each (uint64_t *pml4, pte_for_each_func *func, void *aux) {
@@ -161,24 +315,36 @@ pml4_for_each (uint64_t *pml4, pte_for_each_func *func, void *aux) {
 	return true;
 }
 
+/* In the VM build, user pages belong to the frame table, which
+ * frees them when their last page goes away (pages may be shared
+ * between processes), so page table teardown frees only the
+ * tables themselves. */
 static void
 pt_destroy (uint64_t *pt) {
+#ifndef VM
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
 		uint64_t *pte = ptov((uint64_t *) pt[i]);
 		if (((uint64_t) pte) & PTE_P)
 			palloc_free_page ((void *) PTE_ADDR (pte));
 	}
-	palloc_free_page ((void *) pt);
+#endif
+	pt_free ((void *) pt);
 }
 
 static void
 pgdir_destroy (uint64_t *pdp) {
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
 		uint64_t *pte = ptov((uint64_t *) pdp[i]);
-		if (((uint64_t) pte) & PTE_P)
-			pt_destroy (PTE_ADDR (pte));
+		if (((uint64_t) pte) & PTE_P) {
+			if (pdp[i] & PTE_PS) {
+#ifndef VM
+				palloc_free_multiple (ptov (HPTE_ADDR (pdp[i])), HPG_PAGES);
+#endif
+			} else
+				pt_destroy (PTE_ADDR (pte));
+		}
 	}
-	palloc_free_page ((void *) pdp);
+	pt_free ((void *) pdp);
 }
 
 static void
@@ -188,28 +354,335 @@ pdpe_destroy (uint64_t *pdpe) {
 		if (((uint64_t) pde) & PTE_P)
 			pgdir_destroy ((void *) PTE_ADDR (pde));
 	}
-	palloc_free_page ((void *) pdpe);
+	pt_free ((void *) pdpe);
 }
 
-/* Destroys pml4e, freeing all the pages it references. */
+/* ---- PCID ---- */
+
+/* With CR4.PCIDE set, the CPU tags every TLB entry with the 12-bit
+ * process-context identifier in CR3[11:0], and a CR3 load with
+ * CR3_NOFLUSH keeps the entries of all PCIDs.  Switching between
+ * user processes then costs no TLB refill.
+ *
+ * PCID 0 always belongs to base_pml4.  The others are handed out
+ * from a small pool in allocation order.  When the pool runs dry,
+ * a new generation starts and every older assignment becomes
+ * invalid; a PCID is always flushed when it gets a new owner, so
+ * whatever the previous owner left behind is never used.
+ *
+ * invlpg only reaches the active PCID, so a PTE change in an
+ * inactive pml4 marks its PCID stale and the next activation
+ * flushes it. */
+
+#define CR4_PCIDE (1 << 17)            /* CR4: enable PCIDs. */
+#define CPUID_1_ECX_PCID (1 << 17)     /* CPUID.01H:ECX: PCIDs supported. */
+#define CR3_NOFLUSH (1ULL << 63)       /* CR3 load: keep this PCID's TLB. */
+#define PCID_CNT 32                    /* PCIDs in the pool, including 0. */
+
+struct pcid_slot {
+	uint64_t *pml4;                 /* Owner, or NULL if free. */
+	unsigned long long gen;         /* Generation of the assignment. */
+	bool stale;                     /* Owner's PTEs changed while inactive. */
+};
+
+static struct pcid_slot pcid_slots[PCID_CNT];
+static unsigned long long pcid_gen = 1;    /* Current generation. */
+static unsigned pcid_next = 1;             /* Next PCID to hand out. */
+static bool pcid_enabled;                  /* CR4.PCIDE is set. */
+
+/* Set by -nopcid: flush the whole TLB on every switch. */
+bool pcid_disabled;
+
+/* Statistics. */
+static unsigned long long activate_cnt;     /* pml4_activate() calls. */
+static unsigned long long activate_flush_cnt; /* ...that flushed the TLB. */
+static unsigned long long activate_cycles;  /* TSC cycles spent in them. */
+static unsigned long long pcid_rollover_cnt;  /* Generations started. */
+
+/* Turns PCIDs on if the CPU supports them and -nopcid was not
+ * given.  Must run while PCID 0 is loaded in CR3. */
 void
-pml4_destroy (uint64_t *pml4) {
-	if (pml4 == NULL)
+pcid_init (void) {
+	uint32_t eax, ebx, ecx, edx;
+
+	if (pcid_disabled)
 		return;
-	ASSERT (pml4 != base_pml4);
+	cpuid (1, &eax, &ebx, &ecx, &edx);
+	if (!(ecx & CPUID_1_ECX_PCID))
+		return;
+
+	ASSERT ((rcr3 () & PGMASK) == 0);
+	lcr4 (rcr4 () | CR4_PCIDE);
+	pcid_enabled = true;
+}
+
+/* Returns the slot of the PCID PML4 owns in the current
+ * generation, or NULL.  Interrupts must be off. */
+static struct pcid_slot *
+pcid_find (uint64_t *pml4) {
+	for (unsigned i = 1; i < PCID_CNT; i++)
+		if (pcid_slots[i].pml4 == pml4 && pcid_slots[i].gen == pcid_gen)
+			return &pcid_slots[i];
+	return NULL;
+}
+
+/* Returns the CR3 PCID bits for activating PML4: its PCID, plus
+ * CR3_NOFLUSH if its cached translations are still good.
+ * Interrupts must be off. */
+static uint64_t
+pcid_assign (uint64_t *pml4) {
+	struct pcid_slot *slot;
+
+	if (pml4 == base_pml4)
+		return CR3_NOFLUSH;
+
+	slot = pcid_find (pml4);
+	if (slot != NULL) {
+		if (!slot->stale)
+			return (slot - pcid_slots) | CR3_NOFLUSH;
+		slot->stale = false;
+		return slot - pcid_slots;
+	}
 
+	if (pcid_next == PCID_CNT) {
+		pcid_gen++;
+		pcid_next = 1;
+		pcid_rollover_cnt++;
+	}
+	slot = &pcid_slots[pcid_next++];
+	slot->pml4 = pml4;
+	slot->gen = pcid_gen;
+	slot->stale = false;
+	return slot - pcid_slots;
+}
+
+/* Gives up any PCID held by PML4, which is being destroyed. */
+static void
+pcid_release (uint64_t *pml4) {
+	enum intr_level old_level = intr_disable ();
+	for (unsigned i = 1; i < PCID_CNT; i++)
+		if (pcid_slots[i].pml4 == pml4)
+			pcid_slots[i].pml4 = NULL;
+	intr_set_level (old_level);
+}
+
+/* Returns true if PML4 is the page table the CPU is using. */
+static bool
+pml4_is_active (uint64_t *pml4) {
+	return PTE_ADDR (rcr3 ()) == vtop (pml4);
+}
+
+/* Makes the next activation of the inactive PML4 flush whatever
+ * the TLB still holds for it. */
+static void
+pcid_mark_stale (uint64_t *pml4) {
+	if (pcid_enabled) {
+		enum intr_level old_level = intr_disable ();
+		struct pcid_slot *slot = pcid_find (pml4);
+		if (slot != NULL)
+			slot->stale = true;
+		intr_set_level (old_level);
+	}
+}
+
+/* Drops cached translations of VA in PML4 after its PTE changed.
+ * Only the active pml4 can be invalidated page by page; any other
+ * one is flushed as a whole the next time it is activated. */
+static void
+tlb_invalidate (uint64_t *pml4, const void *va) {
+	if (pml4_is_active (pml4))
+		invlpg ((uint64_t) va);
+	else
+		pcid_mark_stale (pml4);
+}
+
+/* ---- Batched invalidation ---- */
+
+/* Unmapping or aging many pages one invlpg at a time serializes
+ * the CPU once per page.  Callers that change many PTEs of one
+ * pml4 instead gather the pages in a tlb_batch through the *_batch
+ * variants below and call tlb_batch_flush() once at the end: up to
+ * TLB_BATCH_MAX pages are invalidated one by one, more than that
+ * by reloading CR3, which drops every non-global translation of
+ * the current address space.
+ *
+ * Pintos runs on a single CPU, so no other CPU can hold the
+ * translations and there is no shootdown to send. */
+
+static unsigned long long batch_flush_cnt;  /* Non-empty batches flushed. */
+static unsigned long long batch_page_cnt;   /* Pages in them. */
+static unsigned long long batch_full_cnt;   /* ...flushed by a CR3 reload. */
+
+/* Starts an empty batch for changes to PML4. */
+void
+tlb_batch_init (struct tlb_batch *batch, uint64_t *pml4) {
+	batch->pml4 = pml4;
+	batch->cnt = 0;
+}
+
+/* Records that the PTE for VA in BATCH's pml4 has changed. */
+void
+tlb_batch_add (struct tlb_batch *batch, const void *va) {
+	uint64_t page = (uint64_t) pg_round_down (va);
+
+	if (batch->cnt > 0 && batch->cnt <= TLB_BATCH_MAX
+			&& batch->va[batch->cnt - 1] == page)
+		return;
+	if (batch->cnt < TLB_BATCH_MAX)
+		batch->va[batch->cnt] = page;
+	batch->cnt++;
+}
+
+/* Drops the cached translations of every page added to BATCH and
+ * empties it. */
+void
+tlb_batch_flush (struct tlb_batch *batch) {
+	if (batch->cnt == 0)
+		return;
+
+	enum intr_level old_level = intr_disable ();
+	if (!pml4_is_active (batch->pml4))
+		pcid_mark_stale (batch->pml4);
+	else if (batch->cnt <= TLB_BATCH_MAX) {
+		for (size_t i = 0; i < batch->cnt; i++)
+			invlpg (batch->va[i]);
+	} else {
+		lcr3 (rcr3 ());
+		batch_full_cnt++;
+	}
+	batch_flush_cnt++;
+	batch_page_cnt += batch->cnt;
+	intr_set_level (old_level);
+
+	batch->cnt = 0;
+}
+
+/* Invalidates VA in PML4 right away, or adds it to BATCH if that
+ * is not a null pointer. */
+static void
+pte_changed (uint64_t *pml4, const void *va, struct tlb_batch *batch) {
+	if (batch != NULL) {
+		ASSERT (batch->pml4 == pml4);
+		tlb_batch_add (batch, va);
+	} else
+		tlb_invalidate (pml4, va);
+}
+
+/* Frees PML4 and all the pages it references. */
+static void
+pml4_free_tables (uint64_t *pml4) {
 	/* if PML4 (vaddr) >= 1, it's kernel space by define. */
 	uint64_t *pdpe = ptov ((uint64_t *) pml4[0]);
 	if (((uint64_t) pdpe) & PTE_P)
 		pdpe_destroy ((void *) PTE_ADDR (pdpe));
-	palloc_free_page ((void *) pml4);
+	pt_free ((void *) pml4);
+}
+
+/* ---- Lazy teardown ---- */
+
+/* pml4_destroy() only queues the pml4; the reaper thread walks and
+ * frees it later, so process exit does not pay for the size of the
+ * address space.  A dead pml4 has no use for its kernel entries,
+ * so the queue is linked through its last one.  When palloc runs
+ * out of pages it calls pml4_reap_sync() to free the queue at
+ * once. */
+#define PML4_LINK (PGSIZE / sizeof (uint64_t) - 1)
+
+static uint64_t *zombie_pml4s;          /* Queue of pml4s to free. */
+static struct semaphore reap_sema;      /* Upped once per queued pml4. */
+static bool reaper_started;
+static unsigned long long reap_cnt;     /* pml4s freed by the reaper. */
+static unsigned long long reap_sync_cnt;  /* ...freed by pml4_reap_sync(). */
+
+/* Takes the next pml4 off the queue, or returns NULL. */
+static uint64_t *
+zombie_pop (void) {
+	enum intr_level old_level = intr_disable ();
+	uint64_t *pml4 = zombie_pml4s;
+	if (pml4 != NULL)
+		zombie_pml4s = (uint64_t *) pml4[PML4_LINK];
+	intr_set_level (old_level);
+	return pml4;
+}
+
+static void
+pml4_reaper (void *aux UNUSED) {
+	for (;;) {
+		sema_down (&reap_sema);
+		uint64_t *pml4 = zombie_pop ();
+		if (pml4 != NULL) {
+			pml4_free_tables (pml4);
+			reap_cnt++;
+		}
+	}
+}
+
+/* Starts the thread that frees destroyed pml4s. */
+void
+pml4_reaper_init (void) {
+	sema_init (&reap_sema, 0);
+	reaper_started = true;
+	thread_create ("pml4_reaper", PRI_DEFAULT, pml4_reaper, NULL);
+}
+
+/* Frees every queued pml4 and the page-table page cache right
+ * away.  Returns true if that gave any memory back. */
+bool
+pml4_reap_sync (void) {
+	bool reaped = false;
+	uint64_t *pml4;
+
+	while ((pml4 = zombie_pop ()) != NULL) {
+		pml4_free_tables (pml4);
+		reap_sync_cnt++;
+		reaped = true;
+	}
+	return pt_cache_drain () || reaped;
+}
+
+/* Destroys pml4e, freeing all the pages it references.  The
+ * freeing itself is left to the reaper thread. */
+void
+pml4_destroy (uint64_t *pml4) {
+	if (pml4 == NULL)
+		return;
+	ASSERT (pml4 != base_pml4);
+	ASSERT (!pml4_is_active (pml4));
+
+	pcid_release (pml4);
+	if (!reaper_started) {
+		pml4_free_tables (pml4);
+		return;
+	}
+
+	enum intr_level old_level = intr_disable ();
+	pml4[PML4_LINK] = (uint64_t) zombie_pml4s;
+	zombie_pml4s = pml4;
+	intr_set_level (old_level);
+	sema_up (&reap_sema);
 }
 
 /* Loads page directory PD into the CPU's page directory base
- * register. */
+ * register.  With PCIDs, translations cached for PD (and for every
+ * other address space) survive the switch. */
 void
 pml4_activate (uint64_t *pml4) {
-	lcr3 (vtop (pml4 ? pml4 : base_pml4));
+	enum intr_level old_level = intr_disable ();
+	uint64_t start = rdtsc ();
+	uint64_t cr3;
+
+	if (pml4 == NULL)
+		pml4 = base_pml4;
+	cr3 = vtop (pml4);
+	if (pcid_enabled)
+		cr3 |= pcid_assign (pml4);
+	lcr3 (cr3);
+
+	activate_cnt++;
+	if (!(cr3 & CR3_NOFLUSH))
+		activate_flush_cnt++;
+	activate_cycles += rdtsc () - start;
+	intr_set_level (old_level);
 }
 
 /* Looks up the physical address that corresponds to user virtual
@@ -227,8 +700,11 @@ pml4_get_page (uint64_t *pml4, const void *uaddr) {
 
 	uint64_t *pte = pml4e_walk (pml4, (uint64_t) uaddr, 0);
 
-	if (pte && (*pte & PTE_P))
+	if (pte && (*pte & PTE_P)) {
+		if (*pte & PTE_PS)
+			return ptov (HPTE_ADDR (*pte)) + ((uint64_t) uaddr & HPGMASK);
 		return ptov (PTE_ADDR (*pte)) + pg_ofs (uaddr);
+	}
 	return NULL;
 }
 
@@ -258,27 +734,88 @@ pml4_set_page (uint64_t *pml4, void *upage, void *kpage, bool rw) {
 
 	uint64_t *pte = pml4e_walk (pml4, (uint64_t) upage, 1);
 
-	if (pte)
+	if (pte) {
+		bool was_present = (*pte & PTE_P) != 0;
 		*pte = vtop (kpage) | PTE_P | (rw ? PTE_W : 0) | PTE_U;
+		if (was_present)
+			tlb_invalidate (pml4, upage);
+	}
 	return pte != NULL;
 }
 
+/* Maps the 2 MB user region starting at UPAGE to the physically
+ * contiguous, 2 MB aligned pages starting at kernel virtual
+ * address KPAGE with a single PDE.  Nothing in the region may be
+ * mapped yet; an empty page table left over there is freed.
+ * Returns true if successful, false if the region is in use or
+ * memory allocation failed. */
+bool
+pml4_set_huge_page (uint64_t *pml4, void *upage, void *kpage, bool rw) {
+	ASSERT (((uint64_t) upage & HPGMASK) == 0);
+	ASSERT (((uint64_t) kpage & HPGMASK) == 0);
+	ASSERT (is_user_vaddr (upage));
+	ASSERT (pml4 != base_pml4);
+
+	uint64_t *pde = pml4e_walk_huge (pml4, (uint64_t) upage, 1);
+	if (pde == NULL)
+		return false;
+
+	if (*pde & PTE_P) {
+		if (*pde & PTE_PS)
+			return false;
+		uint64_t *pt = ptov (PTE_ADDR (*pde));
+		for (unsigned i = 0; i < PGSIZE / sizeof (uint64_t *); i++)
+			if (pt[i] & PTE_P)
+				return false;
+		pt_free (pt);
+	}
+	*pde = vtop (kpage) | PTE_PS | PTE_P | (rw ? PTE_W : 0) | PTE_U;
+	tlb_invalidate (pml4, upage);
+	return true;
+}
+
 /* Marks user virtual page UPAGE "not present" in page
  * directory PD.  Later accesses to the page will fault.  Other
  * bits in the page table entry are preserved.
  * UPAGE need not be mapped. */
 void
 pml4_clear_page (uint64_t *pml4, void *upage) {
+	pml4_clear_page_batch (pml4, upage, NULL);
+}
+
+/* Like pml4_clear_page(), but leaves the TLB invalidation to
+ * tlb_batch_flush (BATCH). */
+void
+pml4_clear_page_batch (uint64_t *pml4, void *upage, struct tlb_batch *batch) {
 	uint64_t *pte;
 	ASSERT (pg_ofs (upage) == 0);
 	ASSERT (is_user_vaddr (upage));
 
-	pte = pml4e_walk (pml4, (uint64_t) upage, false);
+	pte = pml4e_walk_split (pml4, (uint64_t) upage);
 
 	if (pte != NULL && (*pte & PTE_P) != 0) {
 		*pte &= ~PTE_P;
-		if (rcr3 () == vtop (pml4))
-			invlpg ((uint64_t) upage);
+		pte_changed (pml4, upage, batch);
+	}
+}
+
+
+/* Grants or revokes write access in the PTE for user virtual page
+ * UPAGE in PML4, for sharing pages copy-on-write.  Does nothing if
+ * UPAGE is not mapped. */
+void
+pml4_set_writable (uint64_t *pml4, void *upage, bool writable) {
+	uint64_t *pte;
+	ASSERT (pg_ofs (upage) == 0);
+	ASSERT (is_user_vaddr (upage));
+
+	pte = pml4e_walk_split (pml4, (uint64_t) upage);
+	if (pte != NULL && (*pte & PTE_P) != 0) {
+		if (writable)
+			*pte |= PTE_W;
+		else
+			*pte &= ~(uint64_t) PTE_W;
+		tlb_invalidate (pml4, upage);
 	}
 }
 
@@ -295,18 +832,26 @@ pml4_is_dirty (uint64_t *pml4, const void *vpage) {
 
 
 /* Set the dirty bit to DIRTY in the PTE for virtual page VPAGE
- * in PML4. */
+ * in PML4.  A 2 MB page is split so the other pages keep their
+ * own dirty state. */
 void
 pml4_set_dirty (uint64_t *pml4, const void *vpage, bool dirty) {
-	uint64_t *pte = pml4e_walk (pml4, (uint64_t) vpage, false);
+	pml4_set_dirty_batch (pml4, vpage, dirty, NULL);
+}
+
+/* Like pml4_set_dirty(), but leaves the TLB invalidation to
+ * tlb_batch_flush (BATCH). */
+void
+pml4_set_dirty_batch (uint64_t *pml4, const void *vpage, bool dirty,
+		struct tlb_batch *batch) {
+	uint64_t *pte = pml4e_walk_split (pml4, (uint64_t) vpage);
 	if (pte) {
 		if (dirty)
 			*pte |= PTE_D;
 		else
 			*pte &= ~(uint32_t) PTE_D;
 
-		if (rcr3 () == vtop (pml4))
-			invlpg ((uint64_t) vpage);
+		pte_changed (pml4, vpage, batch);
 	}
 }
 
@@ -332,6 +877,14 @@ pml4_is_accessed (uint64_t *pml4, const void *vpage) {
    VPAGE in PD. */
 void
 pml4_set_accessed (uint64_t *pml4, const void *vpage, bool accessed) {
+	pml4_set_accessed_batch (pml4, vpage, accessed, NULL);
+}
+
+/* Like pml4_set_accessed(), but leaves the TLB invalidation to
+ * tlb_batch_flush (BATCH). */
+void
+pml4_set_accessed_batch (uint64_t *pml4, const void *vpage, bool accessed,
+		struct tlb_batch *batch) {
 	uint64_t *pte = pml4e_walk (pml4, (uint64_t) vpage, false);
 	if (pte) {
 		if (accessed)
@@ -339,7 +892,24 @@ pml4_set_accessed (uint64_t *pml4, const void *vpage, bool accessed) {
 		else
 			*pte &= ~(uint32_t) PTE_A;
 
-		if (rcr3 () == vtop (pml4))
-			invlpg ((uint64_t) vpage);
+		pte_changed (pml4, vpage, batch);
 	}
 }
+
+/* Prints TLB and page-table statistics. */
+void
+mmu_print_stats (void) {
+	printf ("TLB: %llu address space switches, %llu flushed the TLB, "
+			"%llu cycles each, PCIDs %s",
+			activate_cnt, activate_flush_cnt,
+			activate_cnt ? activate_cycles / activate_cnt : 0,
+			pcid_enabled ? "on" : "off");
+	if (pcid_enabled)
+		printf (" (%llu rollovers)", pcid_rollover_cnt);
+	printf ("\n");
+	printf ("TLB: %llu batched flushes of %llu pages, %llu by CR3 reload\n",
+			batch_flush_cnt, batch_page_cnt, batch_full_cnt);
+	printf ("Page tables: %llu pml4s reaped, %llu freed on demand, "
+			"%llu table pages reused, %zu cached\n",
+			reap_cnt, reap_sync_cnt, pt_cache_hit_cnt, pt_cache_cnt);
+}
@@ -8,7 +8,9 @@
 #include <stdio.h>
 #include <string.h>
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/loader.h"
+#include "threads/mmu.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
 
@@ -31,6 +33,15 @@ struct pool {
 	struct lock lock;               /* Mutual exclusion. */
 	struct bitmap *used_map;        /* Bitmap of free pages. */
 	uint8_t *base;                  /* Base of pool. */
+
+	/* Statistics.  Updated with interrupts off, because pages are
+	   also freed from the scheduler, where LOCK cannot be taken. */
+	size_t page_cnt;                /* Usable pages in the pool. */
+	size_t used_cnt;                /* Pages currently handed out. */
+	size_t peak_cnt;                /* High-water mark of USED_CNT. */
+	unsigned long long alloc_cnt;   /* Successful palloc_get_multiple() calls. */
+	unsigned long long free_cnt;    /* palloc_free_multiple() calls. */
+	unsigned long long fail_cnt;    /* Requests that found no free run. */
 };
 
 /* Two pools: one for kernel data, one for user pages. */
@@ -250,6 +261,10 @@ palloc_init (void) {
 	printf ("\text_mem: 0x%llx ~ 0x%llx (Usable: %'llu kB)\n",
 		  ext_mem.start, ext_mem.end, ext_mem.size / 1024);
 	populate_pools (&base_mem, &ext_mem);
+	kernel_pool.page_cnt = bitmap_count (kernel_pool.used_map, 0,
+			bitmap_size (kernel_pool.used_map), false);
+	user_pool.page_cnt = bitmap_count (user_pool.used_map, 0,
+			bitmap_size (user_pool.used_map), false);
 	return ext_mem.end;
 }
 
@@ -261,11 +276,70 @@ palloc_init (void) {
    FLAGS, in which case the kernel panics. */
 void *
 palloc_get_multiple (enum palloc_flags flags, size_t page_cnt) {
+	return palloc_get_multiple_aligned (flags, page_cnt, 1);
+}
+
+/* Finds PAGE_CNT free pages in POOL starting at an address that is
+   a multiple of ALIGN_CNT pages, marks them used and returns the
+   index of the first one, or BITMAP_ERROR.  POOL's lock must be
+   held. */
+static size_t
+scan_aligned (struct pool *pool, size_t page_cnt, size_t align_cnt) {
+	size_t pool_size = bitmap_size (pool->used_map);
+	size_t base_no = pg_no (pool->base);
+	size_t page_idx = (align_cnt - base_no % align_cnt) % align_cnt;
+
+	for (; page_idx + page_cnt <= pool_size; page_idx += align_cnt)
+		if (!bitmap_contains (pool->used_map, page_idx, page_cnt, true)) {
+			bitmap_set_multiple (pool->used_map, page_idx, page_cnt, true);
+			return page_idx;
+		}
+	return BITMAP_ERROR;
+}
+
+/* Like palloc_get_multiple(), but the first page is aligned to a
+   multiple of ALIGN_CNT pages, which must be a power of 2.  Used
+   to obtain the physically contiguous backing of a 2 MB page. */
+void *
+palloc_get_multiple_aligned (enum palloc_flags flags, size_t page_cnt,
+		size_t align_cnt) {
 	struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+	bool may_reap = pool == &kernel_pool;
+	size_t page_idx;
+
+	ASSERT (align_cnt > 0 && (align_cnt & (align_cnt - 1)) == 0);
+
+#ifndef VM
+	/* Without VM, the reaper frees user pages along with the page
+	   tables that map them.  With VM, those belong to the frame
+	   table, and reaping would only drain the page table cache. */
+	may_reap = true;
+#endif
+
+	/* If the pool is dry, free the page tables of exited processes
+	   that are still waiting for the reaper and try once more. */
+	for (int try = 0; ; try++) {
+		lock_acquire (&pool->lock);
+		if (align_cnt == 1)
+			page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
+		else
+			page_idx = scan_aligned (pool, page_cnt, align_cnt);
+		lock_release (&pool->lock);
+
+		if (page_idx != BITMAP_ERROR || try > 0 || !may_reap
+				|| !pml4_reap_sync ())
+			break;
+	}
 
-	lock_acquire (&pool->lock);
-	size_t page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
-	lock_release (&pool->lock);
+	enum intr_level old_level = intr_disable ();
+	if (page_idx != BITMAP_ERROR) {
+		pool->alloc_cnt++;
+		pool->used_cnt += page_cnt;
+		if (pool->used_cnt > pool->peak_cnt)
+			pool->peak_cnt = pool->used_cnt;
+	} else
+		pool->fail_cnt++;
+	intr_set_level (old_level);
 	void *pages;
 
 	if (page_idx != BITMAP_ERROR)
@@ -320,6 +394,11 @@ palloc_free_multiple (void *pages, size_t page_cnt) {
 #endif
 	ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
 	bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+
+	enum intr_level old_level = intr_disable ();
+	pool->free_cnt++;
+	pool->used_cnt -= page_cnt;
+	intr_set_level (old_level);
 }
 
 /* Frees the page at PAGE. */
@@ -328,6 +407,37 @@ palloc_free_page (void *page) {
 	palloc_free_multiple (page, 1);
 }
 
+/* Returns the first page of the user pool and stores the number
+   of pages it spans in *PAGE_CNT, so that a table can be kept
+   with one entry per user page. */
+void *
+palloc_user_pool_range (size_t *page_cnt) {
+	*page_cnt = bitmap_size (user_pool.used_map);
+	return user_pool.base;
+}
+
+/* Returns the number of free pages in the user pool. */
+size_t
+palloc_user_free_cnt (void) {
+	return user_pool.page_cnt - user_pool.used_cnt;
+}
+
+/* Prints the usage statistics of pool P, named NAME. */
+static void
+print_pool_stats (const char *name, struct pool *p) {
+	printf ("%s pool: %zu/%zu pages used, peak %zu, "
+			"%llu allocs, %llu frees, %llu failures\n",
+			name, p->used_cnt, p->page_cnt, p->peak_cnt,
+			p->alloc_cnt, p->free_cnt, p->fail_cnt);
+}
+
+/* Prints page allocator statistics. */
+void
+palloc_print_stats (void) {
+	print_pool_stats ("Kernel", &kernel_pool);
+	print_pool_stats ("User", &user_pool);
+}
+
 /* Initializes pool P as starting at START and ending at END */
 static void
 init_pool (struct pool *p, void **bm_base, uint64_t start, uint64_t end) {
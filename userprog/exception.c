@@ -4,6 +4,7 @@
 #include "userprog/gdt.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "userprog/uaccess.h"
 #include "intrinsic.h"
 
 /* Number of page faults processed. */
@@ -152,6 +153,11 @@ page_fault (struct intr_frame *f) {
 		return;
 #endif
 
+	/* A bad user pointer handed to copy_to_user() and friends:
+	   let the copy fail instead of the kernel. */
+	if (!user && fixup_exception (f))
+		return;
+
 	/* Count page faults. */
 	page_fault_cnt++;
 
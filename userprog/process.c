@@ -20,6 +20,7 @@
 #include "intrinsic.h"
 #include "userprog/syscall.h"
 #ifdef VM
+#include <syscall-nr.h>
 #include "vm/vm.h"
 #endif
 
@@ -72,6 +73,8 @@ static void
 initd (void *f_name) {
 #ifdef VM
 	supplemental_page_table_init (&thread_current ()->spt); // 301
+	thread_current ()->stack_limit = vm_stack_limit;
+	thread_current ()->mem_limit = vm_mem_limit;
 #endif
 	process_init ();
 
@@ -203,6 +206,9 @@ __do_fork (void *aux) {
 	supplemental_page_table_init (&child->spt);
 	if (!supplemental_page_table_copy (&child->spt, &parent->spt))
 		goto error;
+	child->stack_bottom = parent->stack_bottom;
+	child->stack_limit = parent->stack_limit;
+	child->mem_limit = parent->mem_limit;
 #else
 	if (!pml4_for_each (parent->pml4, duplicate_pte, parent))
 		goto error;
@@ -365,6 +371,17 @@ process_exit (void) {
 	palloc_free_multiple(curr->fd_table, FDT_PAGES);
 	file_close(curr->running);
 
+#ifdef VM
+	// -memstat: 페이지를 정리하기 전에 메모리 사용량을 출력한다.
+	if (vm_memstat_on_exit && curr->pml4 != NULL) {
+		struct memstat stat;
+
+		vm_memstat(curr, &stat);
+		printf("%s: memstat: rss %lu (anon %lu, file %lu), swap %lu, wss %lu pages\n",
+				curr->name, stat.rss, stat.anon, stat.file, stat.swap, stat.wss);
+	}
+#endif
+
 	// why clean up? do_iret()을 사용하여 PC와 레지스터의 값을 바꿔주어 실행시킬 프로세스로 전환된다.
 	// 그리고 다시 Caller로 돌아오는 일이 없다.
 	process_cleanup (); // 안하면 multi-oom Fail뜬다.  
@@ -383,9 +400,8 @@ process_cleanup (void) {
 	struct thread *curr = thread_current ();
 
 #ifdef VM
-	  if(!hash_empty(&curr->spt.spt_table)){
-        supplemental_page_table_kill(&curr->spt);
-    }
+	// 페이지가 하나도 없어도 VMA(와 다시 연 파일)는 있을 수 있다.
+	supplemental_page_table_kill(&curr->spt);
 #endif
 
 	uint64_t *pml4;
@@ -837,24 +853,14 @@ lazy_load_segment (struct page *page, void *aux) {
 	/* zero_bytes만큼 남는 부분을 ‘0’으로 패딩 */
 	/* file_read 여부 반환 */
 
-	struct file *file = ((struct file_info*)aux)->file;
-	off_t offset = ((struct file_info*)aux)->ofs;
-	size_t page_read_bytes = ((struct file_info*)aux)->read_bytes;
-	size_t page_zero_bytes = PGSIZE - page_read_bytes;
+	/* 페이지에 매핑된 물리 메모리(frame, 커널 가상 주소)에 파일의 데이터를 읽어오고,
+	   남는 부분은 0으로 채운다. 뒤따르는 페이지들도 같이 읽어서 매핑할 수 있다 (fault-around). */
+	/* 제대로 못 읽어오면 FALSE 리턴 (frame은 호출한 쪽이 정리한다) */
+	/* AUX는 페이지가 속한 VMA이다. */
+	struct file_info info;
 
-	// offset부터 읽는다
-	file_seek(file, offset);
-
-	/* 페이지에 매핑된 물리 메모리(frame, 커널 가상 주소)에 파일의 데이터를 읽어온다. */
-	/* 제대로 못 읽어오면 페이지를 FREE시키고 FALSE 리턴 */
-	if (file_read(file, page->frame->kva, page_read_bytes) != (int)page_read_bytes){
-		palloc_free_page(page->frame->kva);
-		return false;
-	}
-	/* 만약 1페이지 못 되게 받아왔다면 남는 데이터를 0으로 초기화한다. */
-	memset(page->frame->kva + page_read_bytes, 0, page_zero_bytes); 
-
-	return true;
+	vma_file_info (aux, page->va, &info);
+	return file_read_around (page, page->frame->kva, &info);
 }
 
 /* Loads a segment starting at offset OFS in FILE at address
@@ -886,6 +892,14 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
 	ASSERT (pg_ofs (upage) == 0);
 	ASSERT (ofs % PGSIZE == 0);
 
+	// 세그먼트가 차지하는 범위를 VMA로 남겨서 mmap이 겹치는지 바로 알 수 있게 한다.
+	// 파일의 어디를 읽을지도 VMA에 한 번만 적어 두고, 페이지는 VMA만 가리킨다.
+	struct vma *vma = vma_create (&thread_current ()->spt.vmas, upage,
+			upage + read_bytes + zero_bytes, VMA_EXEC, file, ofs, writable);
+	if (vma == NULL)
+		return false;
+	vma->file_bytes = read_bytes;
+
 	while (read_bytes > 0 || zero_bytes > 0) {
 		/* Do calculate how to fill this page.
 		 * We will read PAGE_READ_BYTES bytes from FILE
@@ -893,15 +907,20 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
 		size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
 		size_t page_zero_bytes = PGSIZE - page_read_bytes;
 
-		/* TODO: Set up aux to pass information to the lazy_load_segment. */
-		struct file_info *file_info = (struct file_info *) malloc(sizeof(struct file_info));
+		/* A page with nothing to read (BSS) is plain zero-filled
+		 * anonymous memory, which may be backed by the zero page
+		 * until it is written. */
+		if (page_read_bytes == 0) {
+			if (!vm_alloc_page (VM_ANON, upage, writable))
+				return false;
+			zero_bytes -= page_zero_bytes;
+			upage += PGSIZE;
+			continue;
+		}
 
-		// page 멤버들 설정, 가상페이지가 요구될 때 읽어야할 파일의 오프셋과 사이즈, 마지막에 패딩할 제로 바이트 등등
-		file_info->file = file;
-		file_info->ofs = ofs;
-		file_info->read_bytes = page_read_bytes;
-		
-		if (!vm_alloc_page_with_initializer (VM_ANON, upage, writable, lazy_load_segment, file_info))
+		/* TODO: Set up aux to pass information to the lazy_load_segment. */
+		// 읽어야 할 파일의 오프셋과 크기는 VMA와 페이지 주소에서 계산한다
+		if (!vm_alloc_page_with_initializer (VM_ANON, upage, writable, lazy_load_segment, vma))
 			return false;
 
 		/* Advance. */
@@ -924,6 +943,14 @@ bool success = false;
 	 * TODO: You should mark the page is stack. */
 	/* TODO: Your code goes here */
 
+	// 스택이 자랄 수 있는 범위와 그 아래 guard gap을 VMA로 잡아 둔다
+	size_t reserve = thread_current ()->stack_limit + VM_STACK_GUARD;
+	if (reserve >= USER_STACK
+			|| vma_create (&thread_current ()->spt.vmas,
+				(void *) (USER_STACK - reserve), (void *) USER_STACK, VMA_ANON,
+				NULL, 0, true) == NULL)
+		return false;
+
 	if (vm_alloc_page(VM_ANON | VM_STACK, stack_bottom, 1)) {
 		success = vm_claim_page(stack_bottom);
 
@@ -13,6 +13,7 @@
 #include "userprog/process.h"
 #include "kernel/stdio.h"
 #include "threads/palloc.h"
+#include "userprog/uaccess.h"
 /* ------------------------------- */
 #include "../include/vm/vm.h"
 
@@ -20,8 +21,6 @@ void syscall_entry (void);
 void syscall_handler (struct intr_frame *);
 
 /* ---------- Project 2 ---------- */
-void check_address(void *uaddr);
-
 void halt (void);			/* 구현 완료 */
 void exit (int status);		/* 구현 완료 */
 tid_t fork (const char *thread_name, struct intr_frame *f);
@@ -37,10 +36,12 @@ void seek (int fd, unsigned position);
 unsigned tell (int fd);
 void close (int fd);
 /* ------------------------------- */
-// struct page* check_address (void *user_addr);
-void check_valid_buffer(void *buffer, unsigned size, void *rsp, bool to_write);
 void *mmap(void *addr, size_t length, int writable, int fd, off_t offset);
 void munmap(void *addr);
+int madvise(void *addr, size_t length, int advice);
+int msync(void *addr, size_t length, int flags);
+int memstat(struct memstat *stat);
+int memlimit(unsigned long pages);
 
 
 /* System call.
@@ -93,6 +94,9 @@ syscall_handler (struct intr_frame *f UNUSED) {
 
 
 	/* ---------- Project 2 ---------- */
+	// 커널 모드에서 유저 스택에 폴트가 나면 이 값으로 스택 확장 여부를 판단
+	thread_current()->rsp_stack = (void *) f->rsp;
+
 	switch(f->R.rax) {
 		case SYS_HALT:
 			halt();
@@ -124,11 +128,9 @@ syscall_handler (struct intr_frame *f UNUSED) {
 			f->R.rax = filesize(f->R.rdi);
 			break;
 		case SYS_READ:
-			check_valid_buffer(f->R.rsi, f->R.rdx, f->rsp, 1);
 			f->R.rax = read(f->R.rdi, f->R.rsi, f->R.rdx);
 			break;
 		case SYS_WRITE:
-			check_valid_buffer(f->R.rsi, f->R.rdx, f->rsp, 0);
 			f->R.rax = write(f->R.rdi, f->R.rsi, f->R.rdx);
 			break;
 		case SYS_SEEK:
@@ -146,6 +148,18 @@ syscall_handler (struct intr_frame *f UNUSED) {
 		case SYS_MUNMAP:
 			munmap(f->R.rdi);
 			break;
+		case SYS_MADVISE:
+			f->R.rax = madvise((void *) f->R.rdi, f->R.rsi, f->R.rdx);
+			break;
+		case SYS_MSYNC:
+			f->R.rax = msync((void *) f->R.rdi, f->R.rsi, f->R.rdx);
+			break;
+		case SYS_MEMSTAT:
+			f->R.rax = memstat((struct memstat *) f->R.rdi);
+			break;
+		case SYS_MEMLIMIT:
+			f->R.rax = memlimit(f->R.rdi);
+			break;
 		default:
 			exit(-1);
 			break;
@@ -154,30 +168,29 @@ syscall_handler (struct intr_frame *f UNUSED) {
 }
 
 /* ---------- Project 2 ---------- */
-// 주소 값이 유저 영역 주소 값인지 확인 => 유저 영역을 벗어난 영역일 경우 프로세스 종료(exit(-1))
-void check_address(void *user_addr)
-{
-	// struct thread *curr = thread_current();
-	if (is_kernel_vaddr(user_addr)) {
-		exit(-1);
+/* 유저 포인터는 미리 검사하지 않는다.  copy_from_user() 등이 잘못된
+   주소에서 실패하면 그때 프로세스를 종료한다. */
+
+/* Copies the user string USTR into a new page, which the caller
+   must free.  Kills the process if USTR is a bad pointer.  Returns
+   NULL if the string does not fit in a page or no page is free. */
+static char *copy_in_string(const char *ustr) {
+	char *kstr = palloc_get_page(0);
+	long len;
+
+	if (kstr == NULL) {
+		return NULL;
 	}
-	#ifdef VM
-	if (spt_find_page(&thread_current()->spt, user_addr) == NULL){
+	len = strncpy_from_user(kstr, ustr, PGSIZE);
+	if (len < 0) {
+		palloc_free_page(kstr);
 		exit(-1);
 	}
-	#endif
-}
-
-void check_valid_buffer(void *buffer, unsigned size, void *rsp, bool to_write) {
-	for (int i = 0; i < size; i++) {
-		struct page *page = spt_find_page(&thread_current()->spt, buffer + i);
-
-		if (page == NULL)
-			exit(-1);
-		
-		if(to_write == true && page->writable == false)
-			exit(-1);
+	if (len == PGSIZE) {
+		palloc_free_page(kstr);
+		return NULL;
 	}
+	return kstr;
 }
 
 /* Check validity of given file descriptor in current thread fd_table */
@@ -247,23 +260,23 @@ void exit(int status) {
 
 // 3. 현재 프로세스를 복사하는 시스템 콜
 tid_t fork (const char *thread_name, struct intr_frame *f) {
-	check_address(thread_name);
-	return process_fork(thread_name, f);
+	char name[16];	/* 스레드 이름은 어차피 16바이트로 잘린다. */
+
+	if (strncpy_from_user(name, thread_name, sizeof name) < 0) {
+		exit(-1);
+	}
+	name[sizeof name - 1] = '\0';
+	return process_fork(name, f);
 }
 
 
 // 4. 
 int exec(const char *cmd_line) {
-	check_address(cmd_line);
 	/* 인자로 받은 파일 이름 문자열을 복사하여 이 복사본을 인자로 process_exec() 실행*/
-	char *cmd_line_cp;
-	// printf("cmd_line #############################: %s\n", cmd_line);
-	int size = strlen(cmd_line);
-	cmd_line_cp = palloc_get_page(0);
+	char *cmd_line_cp = copy_in_string(cmd_line);
 	if (cmd_line_cp == NULL) {
 		exit(-1);
 	}
-	strlcpy (cmd_line_cp, cmd_line, size + 1);
 
 	if (process_exec(cmd_line_cp) == -1) {
 		return -1;
@@ -277,8 +290,15 @@ int exec(const char *cmd_line) {
 bool create (const char *file, unsigned initial_size) {
 	// 파일 이름과 크기에 해당하는 파일 생성
 	// 파일 생성 성공 시 true 반환, 실패 시 false 반환
-	check_address(file);
-	return filesys_create(file, initial_size);
+	char *name = copy_in_string(file);
+	bool success;
+
+	if (name == NULL) {
+		return false;
+	}
+	success = filesys_create(name, initial_size);
+	palloc_free_page(name);
+	return success;
 }
 
 
@@ -286,24 +306,32 @@ bool create (const char *file, unsigned initial_size) {
 bool remove (const char *file) {
 	// 파일 이름에 해당하는 파일을 제거
 	// 파일 제거 성공 시 true 반환, 실패 시 false 반환
-	check_address(file);
-	return filesys_remove(file);
+	char *name = copy_in_string(file);
+	bool success;
+
+	if (name == NULL) {
+		return false;
+	}
+	success = filesys_remove(name);
+	palloc_free_page(name);
+	return success;
 }
 
 
 // 8. 파일을 열 때 사용하는 시스템 콜
 int open (const char *file) {
-	check_address(file);
+	char *name = copy_in_string(file);
 	// lock_acquire(&filesys_lock);
 
 	// 제대로 파일 생성됐는지 체크
-	if (file == NULL) {
+	if (name == NULL) {
 		// lock_release(&filesys_lock);
 		return -1;
 	}
 
 	// 열려고 하는 파일구조체 받기
-	struct file *open_file = filesys_open(file);
+	struct file *open_file = filesys_open(name);
+	palloc_free_page(name);
 
 	// 파일이 없으면 종료
 	if (open_file == NULL) {
@@ -338,46 +366,53 @@ int filesize (int fd) {
 
 
 // 10. 열린 파일의 데이터를 읽는 시스템 콜
+/* 커널 페이지에 한 페이지씩 읽은 뒤 copy_to_user()로 옮긴다.  유저
+   페이지의 폴트가 filesys_lock을 쥔 채로 나지 않고, 잘못된 버퍼는
+   복사가 실패하는 순간 프로세스를 종료시킨다. */
 int read (int fd, void *buffer, unsigned size) {
-	// 유효한 주소인지 체크
-	check_address(buffer);
-	/* 파일에 동시 접근이 일어날 수 있으므로 Lock 사용 */
-	lock_acquire(&filesys_lock);
-
-	int read_count;
+	unsigned read_count = 0;
+	char *kbuf;
 	/* 파일 디스크립터를 이용하여 파일 객체 검색 */
 	struct file *file_obj = get_file_from_fd_table(fd);
 
-	if (file_obj == NULL) {	/* if no file in fdt, return -1 */
-		lock_release(&filesys_lock);
+	if (file_obj == NULL || fd == STDOUT) {	/* if no file in fdt, return -1 */
 		return -1;
 	}
-	/* STDIN */
-	/* 파일 디스크립터가 0일 경우 키보드에 입력을 버퍼에 저장 후
-		 버퍼의 저장한 크기를 리턴 (input_getc() 이용) */
-	if (fd == STDIN) {
-		int i;
-		unsigned char *buf = buffer;
-		for (i = 0; i < size; i++) {
-			// 키보드의 입력 버퍼에서 글자 하나씩을 받아 반환해주는 함수
-			char c = input_getc();
-			// 읽기 버퍼에 한 char씩 넣는다.
-			*buf++ = c;
-			if (c == '\0')
-				break;
-		}
-		read_count = i;
-	}
-	/* STDOUT */
-	else if (fd == STDOUT) {
-		read_count = -1;
+	kbuf = palloc_get_page(0);
+	if (kbuf == NULL) {
+		return -1;
 	}
-	else {	
-		/* 파일 디스크립터가 0이 아닐 경우 파일의 데이터를 크기만큼 저
-			 장 후 읽은 바이트 수를 리턴*/
-		read_count = file_read(file_obj, buffer, size);
+
+	while (read_count < size) {
+		unsigned chunk = size - read_count < PGSIZE ? size - read_count : PGSIZE;
+		unsigned n;
+
+		/* STDIN */
+		/* 파일 디스크립터가 0일 경우 키보드에 입력을 버퍼에 저장 (input_getc() 이용) */
+		if (fd == STDIN) {
+			for (n = 0; n < chunk; n++) {
+				// 키보드의 입력 버퍼에서 글자 하나씩을 받아 반환해주는 함수
+				kbuf[n] = input_getc();
+				if (kbuf[n] == '\0')
+					break;
+			}
+		}
+		else {
+			/* 파일에 동시 접근이 일어날 수 있으므로 Lock 사용 */
+			lock_acquire(&filesys_lock);
+			n = file_read(file_obj, kbuf, chunk);
+			lock_release(&filesys_lock);
+		}
+
+		if (copy_to_user(buffer + read_count, kbuf, n) != 0) {
+			palloc_free_page(kbuf);
+			exit(-1);
+		}
+		read_count += n;
+		if (n < chunk)
+			break;
 	}
-	lock_release(&filesys_lock);
+	palloc_free_page(kbuf);
 	// 읽은 바이트 수를 리턴
 	return read_count;
 }
@@ -386,37 +421,46 @@ int read (int fd, void *buffer, unsigned size) {
 // 11. 열린 파일의 데이터를 기록하는 시스템 콜
 // byte_cnt = write (handle, sample, sizeof sample - 1);
 int write (int fd, const void *buffer, unsigned size) {
-	check_address(buffer);
-	/* 파일에 동시 접근이 일어날 수 있으므로 Lock 사용 */
-	lock_acquire(&filesys_lock);
-
-	int write_count;
+	unsigned write_count = 0;
+	char *kbuf;
 	/* 파일 디스크립터를 이용하여 파일 객체 검색 */
 	struct file *file_obj = get_file_from_fd_table(fd);
-	
-	if (file_obj == NULL) {
-		lock_release(&filesys_lock);
-		return -1;
-	}
 
-	/* STDOUT */
-	/* 파일 디스크립터가 1일 경우 버퍼에 저장된 값을 화면에 출력
-		 후 버퍼의 크기 리턴 (putbuf() 이용) */
-	if (fd == STDOUT) {
-		putbuf(buffer, size);
-		write_count = size;
-	}
-	/* STDOUT */
-	else if (fd == STDIN) {
-		write_count = -1;
+	if (file_obj == NULL || fd == STDIN) {
+		return -1;
 	}
-	/* 파일 디스크립터가 1이 아닐 경우 버퍼에 저장된 데이터를 크기
-		 만큼 파일에 기록후 기록한 바이트 수를 리턴 */
-	else {
-		write_count = file_write(file_obj, buffer, size);
+	kbuf = palloc_get_page(0);
+	if (kbuf == NULL) {
+		return -1;
 	}
 
-	lock_release(&filesys_lock);
+	while (write_count < size) {
+		unsigned chunk = size - write_count < PGSIZE ? size - write_count : PGSIZE;
+		unsigned n;
+
+		if (copy_from_user(kbuf, buffer + write_count, chunk) != 0) {
+			palloc_free_page(kbuf);
+			exit(-1);
+		}
+
+		/* STDOUT */
+		/* 파일 디스크립터가 1일 경우 버퍼에 저장된 값을 화면에 출력 (putbuf() 이용) */
+		if (fd == STDOUT) {
+			putbuf(kbuf, chunk);
+			n = chunk;
+		}
+		/* 파일 디스크립터가 1이 아닐 경우 버퍼에 저장된 데이터를 크기
+			 만큼 파일에 기록 */
+		else {
+			lock_acquire(&filesys_lock);
+			n = file_write(file_obj, kbuf, chunk);
+			lock_release(&filesys_lock);
+		}
+		write_count += n;
+		if (n < chunk)
+			break;
+	}
+	palloc_free_page(kbuf);
 	// 기록한 바이트 수를 리턴
 	return write_count;
 }
@@ -489,10 +533,7 @@ void *mmap(void *addr, size_t length, int writable, int fd, off_t offset)
 		exit(-1);
 	}
 
-	// 다른 페이지를 건들면 안됨
-	if (spt_find_page(&thread_current()->spt, addr)) {
-		return NULL;
-	}
+	// 다른 영역과 겹치는지는 do_mmap()이 VMA tree에서 확인한다
 
 	// 파일이 NULL이면 안됨
 	struct file *open_file = get_file_from_fd_table(fd);
@@ -509,4 +550,29 @@ void munmap(void *addr) {
 	// 	return;
 	// }
 	do_munmap(addr);
+}
+
+int madvise(void *addr, size_t length, int advice) {
+	return vm_madvise(addr, length, advice) ? 0 : -1;
+}
+
+int msync(void *addr, size_t length, int flags) {
+	return do_msync(addr, length, flags) ? 0 : -1;
+}
+
+/* 현재 프로세스의 메모리 사용량을 유저 버퍼에 복사한다. */
+int memstat(struct memstat *stat) {
+	struct memstat kstat;
+
+	vm_memstat(thread_current(), &kstat);
+	if (copy_to_user(stat, &kstat, sizeof kstat) != 0) {
+		exit(-1);
+	}
+	return 0;
+}
+
+/* 상주 페이지 수의 한도를 바꾼다.  0이면 한도를 없앤다.
+   자식 프로세스에게도 물려준다. */
+int memlimit(unsigned long pages) {
+	return vm_set_mem_limit(pages) ? 0 : -1;
 }
\ No newline at end of file
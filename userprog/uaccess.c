@@ -0,0 +1,113 @@
+#include "userprog/uaccess.h"
+#include "threads/interrupt.h"
+#include "threads/vaddr.h"
+
+/* Bounds of the exception table, from kernel.lds.S. */
+extern const struct exception_entry __start_ex_table[], __stop_ex_table[];
+
+/* Emits an exception table entry sending a fault at label FROM
+   to label TO. */
+#define EX_TABLE(FROM, TO)                      \
+	".pushsection __ex_table, \"a\"\n"          \
+	"	.balign 8\n"                            \
+	"	.quad " #FROM ", " #TO "\n"             \
+	".popsection\n"
+
+/* Returns true if [UADDR, UADDR + SIZE) lies entirely in user
+   space.  Kernel addresses are always mapped, so they would not
+   fault and must be refused up front. */
+static bool
+user_range_ok (const void *uaddr, size_t size) {
+	uint64_t start = (uint64_t) uaddr;
+
+	if (size == 0)
+		return true;
+	return start + size > start && is_user_vaddr (start + size - 1);
+}
+
+/* Copies SIZE bytes from SRC to DST, either of which may be a
+   user address, and returns the number of bytes left uncopied:
+   0 on success.  On a bad page the fault handler resumes after the
+   rep movsb, whose count register holds what was left. */
+static size_t
+copy_user (void *dst, const void *src, size_t size) {
+	asm volatile ("1: rep movsb\n"
+			"2:\n"
+			EX_TABLE (1b, 2b)
+			: "+D" (dst), "+S" (src), "+c" (size)
+			:
+			: "memory");
+	return size;
+}
+
+/* Copies SIZE bytes from user address USRC to kernel buffer DST.
+   Returns the number of bytes that could not be copied, so 0
+   means success. */
+size_t
+copy_from_user (void *dst, const void *usrc, size_t size) {
+	if (!user_range_ok (usrc, size))
+		return size;
+	return copy_user (dst, usrc, size);
+}
+
+/* Copies SIZE bytes from kernel buffer SRC to user address UDST.
+   Returns the number of bytes that could not be copied, so 0
+   means success.  Writing a read-only page fails, which relies
+   on CR0.WP being set. */
+size_t
+copy_to_user (void *udst, const void *src, size_t size) {
+	if (!user_range_ok (udst, size))
+		return size;
+	return copy_user (udst, src, size);
+}
+
+/* Reads one byte at user address USRC into *DST.  Returns false
+   if the page is bad. */
+static inline bool
+get_user (char *dst, const char *usrc) {
+	bool ok = true;
+
+	asm volatile ("1: movb %2, %1\n"
+			"2:\n"
+			".pushsection .text.fixup, \"ax\"\n"
+			"3: movb $0, %0\n"
+			"	jmp 2b\n"
+			".popsection\n"
+			EX_TABLE (1b, 3b)
+			: "+q" (ok), "=q" (*dst)
+			: "m" (*usrc));
+	return ok;
+}
+
+/* Copies the null-terminated string at user address USRC into
+   DST, a kernel buffer of SIZE bytes.  Returns the length of the
+   string, or SIZE if it did not fit, in which case DST is not
+   terminated.  Returns -1 if USRC is a bad pointer. */
+long
+strncpy_from_user (char *dst, const char *usrc, size_t size) {
+	size_t i;
+
+	for (i = 0; i < size; i++) {
+		if (!is_user_vaddr (usrc + i) || !get_user (&dst[i], usrc + i))
+			return -1;
+		if (dst[i] == '\0')
+			return i;
+	}
+	return size;
+}
+
+/* Called by the page-fault handler for a fault in kernel mode that
+   could not be resolved.  If the faulting instruction has an entry
+   in the exception table, redirects F to its fixup code and
+   returns true. */
+bool
+fixup_exception (struct intr_frame *f) {
+	const struct exception_entry *e;
+
+	for (e = __start_ex_table; e < __stop_ex_table; e++)
+		if (e->insn == f->rip) {
+			f->rip = e->fixup;
+			return true;
+		}
+	return false;
+}
@@ -1,20 +1,25 @@
 /* anon.c: Implementation of page for non-disk image (a.k.a. anonymous page). */
 
+#include <stdio.h>
+#include <string.h>
+#include <syscall-nr.h>
 #include "vm/vm.h"
-#include "devices/disk.h"
-
-#include "threads/vaddr.h"
-#include "bitmap.h"
+#include "vm/swap.h"
 #include "threads/mmu.h"
 
+/* Most pages read by one swap-in, counting the faulting one. */
+#define SWAP_READAHEAD 8
+
 /* DO NOT MODIFY BELOW LINE */
-static struct disk *swap_disk;
 static bool anon_swap_in (struct page *page, void *kva);
 static bool anon_swap_out (struct page *page);
 static void anon_destroy (struct page *page);
+static void share_slot_with_siblings (struct page *, swap_slot_t);
 
-struct bitmap *swap_table;
-const size_t SECTORS_PER_PAGE = PGSIZE / DISK_SECTOR_SIZE;
+/* Swap cache statistics. */
+static unsigned long long clean_evict_cnt;  /* Evictions that wrote nothing. */
+static unsigned long long shared_slot_cnt;  /* Slots given to another page. */
+static unsigned long long zero_evict_cnt;   /* All-zero pages dropped. */
 
 /* DO NOT MODIFY this struct */
 static const struct page_operations anon_ops = {
@@ -28,9 +33,7 @@ static const struct page_operations anon_ops = {
 void
 vm_anon_init (void) {
 	/* TODO: Set up the swap_disk. */
-	swap_disk = disk_get(1, 1);
-	size_t swap_size = disk_size(swap_disk);
-	swap_table = bitmap_create(swap_size);
+	swap_init ();
 }
 
 /* Initialize the file mapping */
@@ -46,31 +49,90 @@ anon_initializer (struct page *page, enum vm_type type, void *kva) {
 	page->operations = &anon_ops;
 
 	struct anon_page *anon_page = &page->anon;
-	anon_page->swap_sec = -1;
+	anon_page->swap_slot = SWAP_SLOT_NONE;
 
 	return true;
 }
 
+/* Returns the page after PAGE in its process, if it was swapped
+ * out to the slot after PAGE's SLOT: most likely evicted together
+ * with PAGE, and so likely to be wanted together again. */
+static struct page *
+readahead_candidate (struct page *page, swap_slot_t slot, size_t n) {
+	struct page *next = spt_find_page (&thread_current ()->spt,
+			page->va + n * PGSIZE);
+
+	if (next == NULL || next->frame != NULL
+			|| VM_TYPE (next->operations->type) != VM_ANON
+			|| next->anon.swap_slot != slot + n)
+		return NULL;
+	return next;
+}
+
 /* Swap in the page by read contents from the swap disk. */
+/* 같은 영역에서 PAGE 뒤의 페이지들이 이어진 슬롯에 있으면 한 번의
+ * 디스크 명령으로 같이 읽어서 미리 매핑해 둔다.  accessed bit이
+ * 꺼진 채로 매핑되므로 쓰이지 않으면 clock이 먼저 가져간다.
+ *
+ * 읽은 뒤에도 슬롯은 놓지 않는다 (swap cache).  페이지가 수정되지
+ * 않은 채로 다시 쫓겨나면 디스크에 쓸 필요 없이 매핑만 끊으면 된다.
+ * 스왑이 절반 넘게 차 있으면 슬롯을 바로 돌려준다. */
 static bool
 anon_swap_in (struct page *page, void *kva) {
 	struct anon_page *anon_page = &page->anon;
-	int page_no = anon_page->swap_sec;
+	swap_slot_t slot = anon_page->swap_slot;
+	struct page *pages[SWAP_IO_MAX];
+	struct frame *frames[SWAP_IO_MAX];
+	void *kvas[SWAP_IO_MAX];
+	size_t cnt = 1;
+	bool keep_slot;
+
+	// 스왑슬롯이 없으면 내용이 전부 0인 페이지
+	if (slot == SWAP_SLOT_NONE) {
+		memset (kva, 0, PGSIZE);
+		return true;
+	}
 
-	// bitmap_test (const struct bitmap *b, size_t idx)
-	// 스왑슬롯 사용여부
-	if (bitmap_test(swap_table, page_no) == false) {
-		return false;
+	pages[0] = page;
+	kvas[0] = kva;
+	/* Only in the owner's context: during fork, the child loads
+	 * its parent's pages. */
+	if (page->owner == thread_current () && page->advice != MADV_RANDOM) {
+		while (cnt < SWAP_READAHEAD) {
+			struct page *next = readahead_candidate (page, slot, cnt);
+			if (next == NULL || (frames[cnt] = vm_frame_try_alloc ()) == NULL)
+				break;
+			pages[cnt] = next;
+			kvas[cnt] = frames[cnt]->kva;
+			cnt++;
+		}
 	}
-	
+
 	// 디스크에 있는데이터를 램으로
-	for (int i = 0; i < SECTORS_PER_PAGE; ++i) {
-		// disk_read (struct disk *d, disk_sector_t sec_no, void *buffer)
-		disk_read(swap_disk, page_no * SECTORS_PER_PAGE + i, kva + DISK_SECTOR_SIZE * i);
+	swap_readv (slot, kvas, cnt);
+	keep_slot = !swap_tight ();
+	for (size_t i = 0; i < cnt; i++) {
+		/* A page read ahead that could not be mapped stays out,
+		 * in its slot. */
+		if (i > 0 && !vm_frame_map (pages[i], frames[i]))
+			continue;
+		vm_account_swap (pages[i], -1);
+		if (!keep_slot) {
+			swap_free (slot + i);
+			pages[i]->anon.swap_slot = SWAP_SLOT_NONE;
+		}
 	}
+	return true;
+}
+
+/* Returns true if the page at KVA holds nothing but zeros. */
+static bool
+page_all_zero (const void *kva) {
+	const uint64_t *p = kva;
 
-	// 스왑슬롯 false로 만들기
-	bitmap_set(swap_table, page_no, false);
+	for (size_t i = 0; i < PGSIZE / sizeof *p; i++)
+		if (p[i] != 0)
+			return false;
 	return true;
 }
 
@@ -78,32 +140,97 @@ anon_swap_in (struct page *page, void *kva) {
 static bool
 anon_swap_out (struct page *page) {
 	struct anon_page *anon_page = &page->anon;
-	
-	// false값을 가지는 비트를 찾는다.
-	// bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value)
-	int page_no = bitmap_scan(swap_table, 0, 1, false);
-	if (page_no == BITMAP_ERROR) {
-		return false;
-	}
+	swap_slot_t slot = anon_page->swap_slot;
 
-	// 8번 반복해서 페이지를 디스크에 저장
-	for (int i=0; i<SECTORS_PER_PAGE; ++i) {
-		// disk_write (struct disk *d, disk_sector_t sec_no, const void *buffer)
-		disk_write(swap_disk, page_no * SECTORS_PER_PAGE + i, page->va + DISK_SECTOR_SIZE * i);
+	/* The slot still holds what the page had when it was last read
+	 * or written, unless it has been written to since. */
+	if (slot != SWAP_SLOT_NONE && !pml4_is_dirty (page_pml4 (page), page->va)) {
+		clean_evict_cnt++;
+	}
+	else if (page_all_zero (page->frame->kva)) {
+		/* Nothing to keep: it will read back as the zero page. */
+		if (slot != SWAP_SLOT_NONE)
+			swap_free (slot);
+		anon_page->swap_slot = SWAP_SLOT_NONE;
+		zero_evict_cnt++;
+		pml4_clear_page (page_pml4 (page), page->va);
+		return true;
+	}
+	else {
+		/* A stale slot may still be shared with a process forked
+		 * while the page was out, so never write over it. */
+		if (slot != SWAP_SLOT_NONE)
+			swap_free (slot);
+		anon_page->swap_slot = SWAP_SLOT_NONE;
+		slot = swap_alloc ();
+		if (slot == SWAP_SLOT_NONE) {
+			return false;
+		}
+
+		// 페이지를 디스크의 슬롯에 저장
+		swap_write (slot, page->frame->kva);
+		anon_page->swap_slot = slot;
 	}
 
-	// swap slot의 비트를 true로
-	// bitmap_set (struct bitmap *b, size_t idx, bool value) 
-	bitmap_set(swap_table, page_no, true);
-	  // 해당 페이지의 PTE에서 present bit을 0으로 바꿔준다.
-	pml4_clear_page(thread_current()->pml4, page->va);
+	/* Pages sharing this frame copy-on-write cannot have written
+	 * to it, so the slot is good for them as well. */
+	share_slot_with_siblings (page, slot);
+	vm_account_swap (page, 1);
 
-	anon_page->swap_sec = page_no;
+	// 해당 페이지의 PTE에서 present bit을 0으로 바꿔준다.
+	pml4_clear_page(page_pml4 (page), page->va);
 	return true;
 }
 
+/* Gives the pages that share PAGE's frame, and are about to be
+ * swapped out after it, a reference to SLOT unless they already
+ * have a clean slot of their own. */
+static void
+share_slot_with_siblings (struct page *page, swap_slot_t slot) {
+	for (struct page *sibling = page->frame->maps; sibling != NULL;
+			sibling = sibling->next_map) {
+		if (sibling == page
+				|| VM_TYPE (sibling->operations->type) != VM_ANON)
+			continue;
+		if (sibling->anon.swap_slot != SWAP_SLOT_NONE) {
+			if (!pml4_is_dirty (page_pml4 (sibling), sibling->va))
+				continue;
+			swap_free (sibling->anon.swap_slot);
+		}
+		sibling->anon.swap_slot = swap_dup (slot);
+		pml4_set_dirty (page_pml4 (sibling), sibling->va, false);
+		shared_slot_cnt++;
+	}
+}
+
+/* Makes DST, a new anonymous page, share the contents of SRC, an
+ * anonymous page that is swapped out, instead of reading them in
+ * at fork. */
+void
+anon_share_swapped (struct page *dst, struct page *src) {
+	ASSERT (src->frame == NULL && src->anon.swap_slot != SWAP_SLOT_NONE);
+	ASSERT (dst->anon.swap_slot == SWAP_SLOT_NONE);
+
+	dst->anon.swap_slot = swap_dup (src->anon.swap_slot);
+	vm_account_swap (dst, 1);
+	shared_slot_cnt++;
+}
+
 /* Destroy the anonymous page. PAGE will be freed by the caller. */
 static void
 anon_destroy (struct page *page) {
 	struct anon_page *anon_page = &page->anon;
+	if (page->frame == NULL && anon_page->swap_slot != SWAP_SLOT_NONE)
+		vm_account_swap (page, -1);
+	vm_frame_release (page);
+	if (anon_page->swap_slot != SWAP_SLOT_NONE)
+		swap_free (anon_page->swap_slot);
+}
+
+/* Prints swap cache statistics. */
+void
+anon_print_stats (void) {
+	printf ("Swap cache: %llu clean evictions without I/O, "
+			"%llu slots shared, %llu zero pages dropped\n",
+			clean_evict_cnt, shared_slot_cnt, zero_evict_cnt);
 }
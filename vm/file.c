@@ -1,6 +1,16 @@
-/* file.c: Implementation of memory backed file object (mmaped object). */
+/* file.c: Implementation of memory backed file object (mmaped object).
+ *
+ * A page of a file mapping maps the frame of the file's page cache
+ * page (see filesys/page_cache.c), which every mapping of the file
+ * and read() and write() share.  Writes through the mapping reach
+ * the file when the page cache writes the page back; the mapping
+ * only hands its dirty bit over when it is unmapped or evicted. */
 
 #include "vm/vm.h"
+#include <stdio.h>
+#include <string.h>
+#include <syscall-nr.h>
+#include "filesys/inode.h"
 #include "../include/userprog/process.h"
 #include "../include/lib/round.h"
 #include "../include/threads/mmu.h"
@@ -9,6 +19,19 @@ static bool file_backed_swap_in (struct page *page, void *kva);
 static bool file_backed_swap_out (struct page *page);
 static void file_backed_destroy (struct page *page);
 
+/* Fault-around: a fault on a page read from a file also reads the
+ * pages that follow it in the same file, up to a window that grows
+ * while the process faults sequentially and shrinks when it does
+ * not.  For a file mapping, it maps the pages that follow which are
+ * in the page cache already. */
+#define FAULT_AROUND_MIN 2
+#define FAULT_AROUND_INIT 8
+#define FAULT_AROUND_MAX INODE_READ_PAGES_MAX
+
+/* Fault-around statistics. */
+static unsigned long long around_fault_cnt;  /* Faults that read ahead. */
+static unsigned long long around_page_cnt;   /* Pages mapped by them. */
+
 /* DO NOT MODIFY this struct */
 static const struct page_operations file_ops = {
 	.swap_in = file_backed_swap_in,
@@ -25,58 +48,283 @@ vm_file_init (void) {
 /* Initialize the file backed page */
 bool
 file_backed_initializer (struct page *page, enum vm_type type, void *kva) {
+	/* The uninit page's aux, its mapping, becomes ours; fetch it
+	 * before the union is overwritten. */
+	struct vma *vma = page->uninit.aux;
+
 	/* Set up the handler */
 	page->operations = &file_ops;
 
 	struct file_page *file_page = &page->file;
+	file_page->vma = vma;
+	file_page->cache = NULL;
+	return true;
+}
+
+/* Returns the mapping PAGE, a page of a file mapping, belongs to,
+ * whether it has been claimed or not. */
+struct vma *
+file_page_vma (struct page *page) {
+	if (VM_TYPE (page->operations->type) == VM_UNINIT)
+		return page->uninit.aux;
+	return page->file.vma;
 }
 
+/* Fills INFO with where the contents of PAGE, a page of a file
+ * mapping, come from. */
+void
+file_page_info (struct page *page, struct file_info *info) {
+	vma_file_info (file_page_vma (page), page->va, info);
+}
 
 /* Swap in the page by read contents from the file. */
+/* 파일 매핑 페이지는 file_claim_page()로 page cache 프레임을 매핑하므로,
+ * 여기로 오는 것은 프레임을 따로 가지게 된 경우뿐이다. */
 static bool
 file_backed_swap_in (struct page *page, void *kva) {
-	 struct file_page *file_page UNUSED = &page->file;
+	struct file_info info;
 
 	if(page == NULL){
 			return false;
 	}
 
-	struct file_info *aux = (struct file_info*)page->uninit.aux;
+	file_page_info (page, &info);
+	return file_read_around (page, kva, &info);
+}
 
-	struct file *file = aux->file;
-	off_t offset = aux->ofs;
-	size_t page_read_bytes = aux->read_bytes;
-	size_t page_zero_bytes = PGSIZE - page_read_bytes;
+/* Returns the size of the fault-around window for a fault on PAGE
+ * by thread T, and adapts it: a fault right after the previous
+ * window means the pages are being read in order.  madvise() can
+ * fix it at the largest or at none. */
+static size_t
+fault_around_window (struct thread *t, struct page *page) {
+	size_t pages = t->fault_around_pages;
+	void *va = page->va;
 
-	file_seek(file, offset);
+	if (page->advice == MADV_RANDOM)
+		return 1;
+	if (page->advice == MADV_SEQUENTIAL)
+		return FAULT_AROUND_MAX;
+	if (pages == 0)
+		pages = FAULT_AROUND_INIT;
+	else if (va == t->fault_around_next)
+		pages = pages * 2 < FAULT_AROUND_MAX ? pages * 2 : FAULT_AROUND_MAX;
+	else
+		pages = pages / 2 > FAULT_AROUND_MIN ? pages / 2 : FAULT_AROUND_MIN;
+	t->fault_around_pages = pages;
+	return pages;
+}
 
-	if(file_read(file, kva, page_read_bytes) != (int)page_read_bytes){
+/* Returns the page N pages after PAGE, if it is a page of the
+ * executable yet to be read from the same segment, described by
+ * INFO; its contents then come N pages after PAGE's in the file.
+ * (Pages of file mappings are read through the page cache
+ * instead.) */
+static struct page *
+fault_around_candidate (struct page *page, const struct file_info *info,
+		size_t n) {
+	struct page *next = spt_find_page (&thread_current ()->spt,
+			page->va + n * PGSIZE);
+
+	if (next == NULL || next->frame != NULL
+			|| pml4_get_page (page_pml4 (next), next->va) != NULL)
+		return NULL;
+	if (VM_TYPE (next->operations->type) != VM_UNINIT
+			|| VM_TYPE (next->type) != VM_ANON
+			|| next->uninit.init != lazy_load_segment
+			|| next->uninit.aux != info->vma)
+		return NULL;
+	return next;
+}
+
+/* Reads PAGE, whose contents are described by INFO, into KVA.
+ *
+ * In the owner's context, the pages that follow PAGE in the same
+ * file are read along with it, in one disk command, and mapped, up
+ * to the fault-around window and as long as frames are free without
+ * evicting anything.  They are mapped with the accessed bit clear,
+ * so the clock takes them first if they go unused. */
+bool
+file_read_around (struct page *page, void *kva, const struct file_info *info) {
+	struct thread *curr = thread_current ();
+	struct page *pages[FAULT_AROUND_MAX];
+	struct frame *frames[FAULT_AROUND_MAX];
+	struct file_info infos[FAULT_AROUND_MAX];
+	void *kvas[FAULT_AROUND_MAX];
+	size_t cnt = 1, window;
+	off_t bytes_read;
+	bool success;
+
+	/* Offsets not on a sector boundary take the slow path. */
+	if (info->ofs % DISK_SECTOR_SIZE != 0) {
+		if (file_read_at (info->file, kva, info->read_bytes, info->ofs)
+				!= (off_t) info->read_bytes)
 			return false;
+		memset (kva + info->read_bytes, 0, PGSIZE - info->read_bytes);
+		return true;
+	}
+
+	pages[0] = page;
+	infos[0] = *info;
+	kvas[0] = kva;
+	if (page->owner == curr) {
+		window = fault_around_window (curr, page);
+		while (cnt < window && infos[cnt - 1].read_bytes == PGSIZE) {
+			struct page *next = fault_around_candidate (page, info, cnt);
+			if (next == NULL || (frames[cnt] = vm_frame_try_alloc ()) == NULL)
+				break;
+			pages[cnt] = next;
+			vma_file_info (info->vma, next->va, &infos[cnt]);
+			kvas[cnt] = frames[cnt]->kva;
+			cnt++;
+		}
+		curr->fault_around_next = page->va + cnt * PGSIZE;
+	}
+
+	bytes_read = inode_read_pages (file_get_inode (info->file), kvas, cnt,
+			info->ofs);
+
+	/* Zero what lies past each page's data.  A page the file did not
+	 * fully cover is not mapped, nor is anything after it. */
+	success = bytes_read >= (off_t) info->read_bytes;
+	for (size_t i = 0; i < cnt; i++) {
+		if (bytes_read < (off_t) (i * PGSIZE + infos[i].read_bytes)) {
+			for (size_t j = i > 0 ? i : 1; j < cnt; j++)
+				vm_frame_discard (frames[j]);
+			cnt = i;
+			break;
+		}
+		memset (kvas[i] + infos[i].read_bytes, 0, PGSIZE - infos[i].read_bytes);
+	}
+
+	for (size_t i = 1; i < cnt; i++) {
+		if (VM_TYPE (pages[i]->operations->type) == VM_UNINIT
+				&& !uninit_transmute (pages[i])) {
+			vm_frame_discard (frames[i]);
+			continue;
+		}
+		if (vm_frame_map (pages[i], frames[i]))
+			around_page_cnt++;
+	}
+	if (cnt > 1)
+		around_fault_cnt++;
+	return success;
+}
+
+/* Gets PAGE, a page of a file mapping described by INFO, ready to
+ * map CACHE, its page cache page. */
+static bool
+file_page_attach (struct page *page, struct page *cache) {
+	if (VM_TYPE (page->operations->type) == VM_UNINIT
+			&& !uninit_transmute (page))
+		return false;
+	page->file.cache = cache;
+	return true;
+}
+
+/* Returns the current process's page at VA in file mapping VMA,
+ * making it now if it has not been touched yet, or a null pointer if
+ * memory is exhausted. */
+struct page *
+file_vma_page (struct vma *vma, void *va) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	struct page *page = spt_find_page (spt, va);
+
+	ASSERT (vma->type == VMA_MMAP && vma->start <= va && va < vma->end);
+
+	if (page == NULL && vm_alloc_page_with_initializer (VM_FILE, va,
+				vma->writable, lazy_load_segment, vma))
+		page = spt_find_page (spt, va);
+	return page;
+}
+
+/* Maps the pages of the current process's file mapping that follow
+ * PAGE, described by INFO, as long as their page cache pages are in
+ * memory, up to the fault-around window.  Pages not touched yet are
+ * made for it. */
+static void
+file_map_around (struct page *page, const struct file_info *info) {
+	struct thread *curr = thread_current ();
+	struct inode *inode = file_get_inode (info->file);
+	size_t window = fault_around_window (curr, page);
+	size_t n;
+
+	for (n = 1; n < window; n++) {
+		void *va = page->va + n * PGSIZE;
+		struct page *next, *cache;
+
+		if (va >= info->vma->end)
+			break;
+		cache = page_cache_lookup (inode, info->ofs / PGSIZE + n);
+		if (cache == NULL || cache->frame == NULL)
+			break;
+		next = file_vma_page (info->vma, va);
+		if (next == NULL || page_get_type (next) != VM_FILE
+				|| next->frame != NULL
+				|| !file_page_attach (next, cache)
+				|| !vm_map_shared (next, cache))
+			break;
+		around_page_cnt++;
 	}
+	curr->fault_around_next = page->va + n * PGSIZE;
+	if (n > 1)
+		around_fault_cnt++;
+}
 
-	memset(kva + page_read_bytes, 0, page_zero_bytes);
+/* Maps PAGE, a page of a file mapping, to the frame of the file's
+ * page cache page, which is read in if it is not in memory. */
+bool
+file_claim_page (struct page *page) {
+	struct file_info info;
+	struct page *cache = page->file.cache;
 
+	file_page_info (page, &info);
+	if (VM_TYPE (page->operations->type) == VM_UNINIT || cache == NULL) {
+		cache = page_cache_get (file_get_inode (info.file),
+				info.ofs / PGSIZE);
+		if (cache == NULL || !file_page_attach (page, cache))
+			return false;
+	}
+	/* Read-ahead follows the advice of the mapping that faults. */
+	cache->advice = page->advice;
+	if (!vm_claim_shared (page, cache))
+		return false;
+	if (page->owner == thread_current ())
+		file_map_around (page, &info);
 	return true;
 }
 
+/* Prints fault-around statistics. */
+void
+file_print_stats (void) {
+	printf ("Fault-around: %llu faults mapped %llu more pages\n",
+			around_fault_cnt, around_page_cnt);
+}
+
+
+/* Hands PAGE's dirty bit over to its page cache page. */
+static void
+file_page_pass_dirty (struct page *page) {
+	struct file_page *file_page = &page->file;
+
+	if (file_page->cache != NULL && pml4_is_dirty (page_pml4 (page), page->va)) {
+		file_page->cache->page_cache.dirty = true;
+		pml4_set_dirty (page_pml4 (page), page->va, false);
+	}
+}
 
 /* Swap out the page by writeback contents to the file. */
+/* 파일에 쓰는 것은 같은 프레임의 page cache 페이지가 한다.  여기서는
+ * dirty bit만 넘기고 매핑을 지운다.
+ * (다른 프로세스의 페이지일 수도 있으므로 페이지 주인의 pml4를 쓴다) */
 static bool
 file_backed_swap_out (struct page *page) {
-	struct file_page *file_page UNUSED = &page->file;
-	struct thread *curr = thread_current();
 	if (page == NULL) {
 		return false;
 	}
-	// 수정된 페이지를 파일에 업데이트하고 dirty_bit을 0으로 만든다.
-	struct file_info *file_info = (struct file_info *)page->uninit.aux;
-	if (pml4_is_dirty(curr->pml4, page->va)) {
-		// file_write_at (struct file *file, const void *buffer, off_t size, off_t file_ofs) 
-		file_write_at(file_info->file, page->va, file_info->read_bytes, file_info->ofs);
-		// pml4_is_dirty (uint64_t *pml4, const void *vpage)
-		pml4_set_dirty(curr->pml4, page->va, 0);
-	}
-	pml4_clear_page(thread_current()->pml4, page->va);
+	file_page_pass_dirty (page);
+	pml4_clear_page(page_pml4 (page), page->va);
+	return true;
 }
 
 
@@ -84,69 +332,110 @@ file_backed_swap_out (struct page *page) {
 static void
 file_backed_destroy (struct page *page) {
 	struct file_page *file_page UNUSED = &page->file;
+
+	if (page->frame != NULL)
+		file_page_pass_dirty (page);
+	vm_frame_release (page);
 }
 
 
 /* Do the mmap */
+/* 매핑 전체를 VMA 하나로 기록만 한다.  파일은 VMA가 다시 열어서 가지고,
+ * 페이지(struct page)는 처음 접근할 때 VMA를 보고 만든다
+ * (file_vma_page()).  겹치는지는 VMA tree에서 O(log n)에 확인한다. */
 void *
 do_mmap (void *addr, size_t length, int writable, struct file *file, off_t offset) {
 
 	uint32_t read_bytes = file_length(file) < length ? file_length(file) : length;
 	uint32_t zero_bytes = PGSIZE - (read_bytes % PGSIZE);
-	uint64_t mmap_addr = (uint64_t)addr;
-	struct file *opened_file = file_reopen(file);
+	void *end = addr + ROUND_UP (read_bytes + zero_bytes, PGSIZE);
+	struct vma *vma;
 
-	if (opened_file == NULL)
+	if (end <= addr || end > (void *) USER_STACK)
 		return NULL;
-	// 파일을 페이지 단위로 잘라서 해당파일의 정보를 구조체에 넣는다.
-	while (read_bytes > 0 || zero_bytes > 0) {
-		/* Do calculate how to fill this page.
-		 * We will read PAGE_READ_BYTES bytes from FILE
-		 * and zero the final PAGE_ZERO_BYTES bytes. */
-		size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
-		size_t page_zero_bytes = PGSIZE - page_read_bytes;
-
-		/* TODO: Set up aux to pass information to the lazy_load_segment. */
-		struct file_info *file_info = (struct file_info *)malloc(sizeof(struct file_info));
-		file_info->file = opened_file;
-		file_info->read_bytes = page_read_bytes;
-		file_info->ofs = offset;
-
-		if (!vm_alloc_page_with_initializer (VM_FILE, addr, writable, lazy_load_segment, file_info)) {
-			file_close(opened_file);
-			return NULL;
+	vma = vma_create (&thread_current ()->spt.vmas, addr, end, VMA_MMAP, file,
+			offset, writable);
+	if (vma == NULL)
+		return NULL;
+	vma->file_bytes = read_bytes;
+	return addr;
+}
+
+/* Do the msync */
+/* LENGTH 바이트 범위의 파일 매핑 페이지 중 page cache에 올라온 것들을
+ * 파일에 쓴다.  같은 파일에서 이어지는 페이지끼리 묶어서 page cache에
+ * 넘긴다.  MS_SYNC는 다 쓸 때까지 기다리고, MS_ASYNC는 page cache의
+ * writeback 스레드에 맡기고 바로 돌아온다. */
+bool
+do_msync (void *addr, size_t length, int flags) {
+	struct thread *curr = thread_current ();
+	struct inode *run_inode = NULL;
+	size_t run_first = 0, run_cnt = 0;
+	bool sync = flags == MS_SYNC;
+	struct page *page;
+	uint64_t vpn, end_vpn;
+
+	if ((flags != MS_SYNC && flags != MS_ASYNC)
+			|| !spt_range_mapped (&curr->spt, addr, length))
+		return false;
+
+	/* Only the pages touched so far are in the SPT. */
+	end_vpn = pg_no (addr + length - 1) + 1;
+	for (vpn = pg_no (addr);
+			(page = radix_next (&curr->spt.spt_table, &vpn)) != NULL
+			&& vpn < end_vpn; vpn++) {
+		struct page *cache;
+
+		/* Only a page that has been claimed can have been written. */
+		if (VM_TYPE (page->operations->type) != VM_FILE
+				|| (cache = page->file.cache) == NULL)
+			continue;
+		if (run_cnt > 0 && cache->page_cache.inode == run_inode
+				&& cache->page_cache.index == run_first + run_cnt) {
+			run_cnt++;
+			continue;
 		}
-		/* Advance. */
-		read_bytes -= page_read_bytes;
-		zero_bytes -= page_zero_bytes;
-		addr += PGSIZE;
-		offset += page_read_bytes;
+		if (run_cnt > 0)
+			page_cache_writeback_range (run_inode, run_first, run_cnt, sync);
+		run_inode = cache->page_cache.inode;
+		run_first = cache->page_cache.index;
+		run_cnt = 1;
 	}
-	return mmap_addr;
+	if (run_cnt > 0)
+		page_cache_writeback_range (run_inode, run_first, run_cnt, sync);
+	return true;
 }
 
 /* Do the munmap */
+/* ADDR에서 시작하는 VMA를 찾아, 그 범위에 실제로 있는 페이지만 radix
+ * tree 순서대로 방문한다.  수정된 내용은 페이지가 없어질 때 page
+ * cache로 넘어가고, VMA가 없어질 때 파일 순서대로 묶여서 쓰인다. */
 void
 do_munmap (void *addr) {
 	struct thread *curr = thread_current();
-	 
-	while(true) {
-		// 매핑 해제 => persent bit을 0으로 만든다.
-		struct page *current_page = spt_find_page(&curr->spt, addr);
-		if (current_page == NULL){
-			return;
-		}
+	struct vma *vma = vma_find (&curr->spt.vmas, addr);
+	/* TLB는 페이지마다 비우지 않고 해제가 끝난 뒤 한 번에 비운다. */
+	struct tlb_batch batch;
+	struct page *page;
+	uint64_t vpn, end_vpn;
 
-		// 수정된 페이지를 파일에 업데이트하고 dirty_bit을 0으로 만든다.
-		struct file_info *file_info = (struct file_info *)current_page->uninit.aux;
-		if (pml4_is_dirty(curr->pml4, current_page->va)) {
+	if (vma == NULL || vma->type != VMA_MMAP || vma->start != addr)
+		return;
+	end_vpn = pg_no (vma->end);
 
-			file_write_at(file_info->file, addr, file_info->read_bytes, file_info->ofs);
-			pml4_set_dirty(curr->pml4, current_page->va, 0);
-		}
+	// 매핑 해제 => present bit을 0으로 만든다.
+	tlb_batch_init (&batch, curr->pml4);
+	for (vpn = pg_no (vma->start);
+			(page = radix_next (&curr->spt.spt_table, &vpn)) != NULL
+			&& vpn < end_vpn; vpn++)
+		if (page->frame != NULL)
+			pml4_clear_page_batch (curr->pml4, page->va, &batch);
+	tlb_batch_flush (&batch);
 
-		// present bit을 0으로 만든다.
-		pml4_clear_page(curr->pml4, current_page->va);
-		addr += PGSIZE;
-	}
+	for (vpn = pg_no (vma->start);
+			(page = radix_next (&curr->spt.spt_table, &vpn)) != NULL
+			&& vpn < end_vpn; vpn++)
+		spt_remove_page (&curr->spt, page);
+
+	vma_destroy (&curr->spt.vmas, vma);
 }
@@ -0,0 +1,337 @@
+/* swap.c: Allocation of page-sized slots on the swap disk. */
+
+#include "vm/swap.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "devices/disk.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "vm/zswap.h"
+
+#define SECTORS_PER_SLOT (PGSIZE / DISK_SECTOR_SIZE)
+
+/* Slots are handed out from clusters of SWAP_CLUSTER free slots in
+ * a row, so pages evicted one after another land next to each other
+ * on disk and their writes stay sequential. */
+#define SWAP_CLUSTER 16
+
+/* Runs of slots freed recently.  A new cluster is taken from here
+ * when possible, which saves scanning the map. */
+#define EXTENT_CACHE_CNT 8
+
+struct swap_extent {
+	size_t start;               /* First slot. */
+	size_t cnt;                 /* Number of slots; 0 if unused. */
+};
+
+static struct disk *swap_disk;
+static struct bitmap *swap_map;     /* One bit per slot, set if in use. */
+static uint8_t *slot_ref;           /* Pages referring to each slot. */
+static size_t slot_cnt;
+static struct lock swap_lock;       /* Protects everything below. */
+
+static size_t cursor;               /* Next-fit: where scans start. */
+static size_t cluster_next;         /* Next slot of the current cluster. */
+static size_t cluster_end;          /* End of the current cluster. */
+static struct swap_extent extents[EXTENT_CACHE_CNT];
+
+/* The plug swap_write() queues into, and the thread it is for. */
+static struct swap_plug *active_plug;
+static struct thread *plug_owner;
+
+/* Statistics. */
+static size_t used_cnt;
+static unsigned long long cluster_cnt;      /* Clusters started. */
+static unsigned long long extent_hit_cnt;   /* ...of them from EXTENTS. */
+static unsigned long long single_cnt;       /* Slots found one by one. */
+static unsigned long long read_page_cnt, read_cmd_cnt;
+static unsigned long long write_page_cnt, write_cmd_cnt;
+
+/* Sets up the swap disk, if there is one. */
+void
+swap_init (void) {
+	swap_disk = disk_get (1, 1);
+	slot_cnt = swap_disk != NULL ? disk_size (swap_disk) / SECTORS_PER_SLOT : 0;
+	swap_map = bitmap_create (slot_cnt);
+	slot_ref = calloc (slot_cnt + 1, sizeof *slot_ref);
+	if (swap_map == NULL || slot_ref == NULL)
+		PANIC ("swap: no memory for %zu slots", slot_cnt);
+	lock_init (&swap_lock);
+	zswap_init ();
+}
+
+/* Takes SWAP_CLUSTER slots from a cached extent.  Returns the first
+ * one, or BITMAP_ERROR if no extent is large enough.  Extents whose
+ * slots have since been handed out are dropped. */
+static size_t
+extent_take (void) {
+	for (int i = 0; i < EXTENT_CACHE_CNT; i++) {
+		struct swap_extent *e = &extents[i];
+
+		if (e->cnt < SWAP_CLUSTER)
+			continue;
+		if (bitmap_any (swap_map, e->start, SWAP_CLUSTER)) {
+			e->cnt = 0;
+			continue;
+		}
+		e->start += SWAP_CLUSTER;
+		e->cnt -= SWAP_CLUSTER;
+		return e->start - SWAP_CLUSTER;
+	}
+	return BITMAP_ERROR;
+}
+
+/* Remembers that SLOT is free, growing the extent it adjoins. */
+static void
+extent_add (size_t slot) {
+	struct swap_extent *victim = NULL;
+
+	for (int i = 0; i < EXTENT_CACHE_CNT; i++) {
+		struct swap_extent *e = &extents[i];
+
+		if (e->cnt > 0 && e->start + e->cnt == slot) {
+			e->cnt++;
+			return;
+		}
+		if (e->cnt > 0 && slot + 1 == e->start) {
+			e->start--;
+			e->cnt++;
+			return;
+		}
+		if (victim == NULL || e->cnt < victim->cnt)
+			victim = e;
+	}
+
+	/* Only a lone slot is worth giving up for another one. */
+	if (victim->cnt <= 1) {
+		victim->start = slot;
+		victim->cnt = 1;
+	}
+}
+
+/* Finds SWAP_CLUSTER free slots in a row, from the extent cache or
+ * by a next-fit scan, and makes them the current cluster.  Returns
+ * false if there is no such run. */
+static bool
+cluster_refill (void) {
+	size_t start = extent_take ();
+
+	if (start != BITMAP_ERROR)
+		extent_hit_cnt++;
+	else {
+		start = bitmap_scan (swap_map, cursor, SWAP_CLUSTER, false);
+		if (start == BITMAP_ERROR && cursor > 0)
+			start = bitmap_scan (swap_map, 0, SWAP_CLUSTER, false);
+		if (start == BITMAP_ERROR)
+			return false;
+		cursor = start + SWAP_CLUSTER < slot_cnt ? start + SWAP_CLUSTER : 0;
+	}
+	cluster_next = start;
+	cluster_end = start + SWAP_CLUSTER;
+	cluster_cnt++;
+	return true;
+}
+
+/* Returns the next free slot after the cursor, wrapping around, or
+ * BITMAP_ERROR if swap is full. */
+static size_t
+single_slot (void) {
+	size_t slot = bitmap_scan (swap_map, cursor, 1, false);
+
+	if (slot == BITMAP_ERROR && cursor > 0)
+		slot = bitmap_scan (swap_map, 0, 1, false);
+	if (slot != BITMAP_ERROR) {
+		cursor = slot + 1 < slot_cnt ? slot + 1 : 0;
+		single_cnt++;
+	}
+	return slot;
+}
+
+/* Allocates a swap slot.  Returns SWAP_SLOT_NONE if swap is full. */
+swap_slot_t
+swap_alloc (void) {
+	size_t slot;
+
+	lock_acquire (&swap_lock);
+	if (cluster_next < cluster_end || cluster_refill ())
+		slot = cluster_next++;
+	else
+		slot = single_slot ();
+	if (slot != BITMAP_ERROR) {
+		ASSERT (!bitmap_test (swap_map, slot));
+		bitmap_mark (swap_map, slot);
+		slot_ref[slot] = 1;
+		used_cnt++;
+	}
+	lock_release (&swap_lock);
+	return slot != BITMAP_ERROR ? slot : SWAP_SLOT_NONE;
+}
+
+/* Adds a reference to SLOT, for a page that shares its contents,
+ * and returns SLOT. */
+swap_slot_t
+swap_dup (swap_slot_t slot) {
+	lock_acquire (&swap_lock);
+	ASSERT (bitmap_test (swap_map, slot));
+	ASSERT (slot_ref[slot] < UINT8_MAX);
+	slot_ref[slot]++;
+	lock_release (&swap_lock);
+	return slot;
+}
+
+/* Drops a reference to SLOT, freeing it with the last one. */
+void
+swap_free (swap_slot_t slot) {
+	lock_acquire (&swap_lock);
+	ASSERT (bitmap_test (swap_map, slot));
+	ASSERT (slot_ref[slot] > 0);
+	if (--slot_ref[slot] == 0) {
+		bitmap_reset (swap_map, slot);
+		used_cnt--;
+		extent_add (slot);
+		/* Before the slot can be handed out again. */
+		zswap_invalidate (slot);
+	}
+	lock_release (&swap_lock);
+}
+
+/* Returns true if more than half of swap is in use, in which case
+ * resident pages should not hold on to their slots. */
+bool
+swap_tight (void) {
+	return used_cnt * 2 > slot_cnt;
+}
+
+/* Reads the pages in the CNT slots from SLOT on into KVAS[0],
+ * KVAS[1], and so on.  Pages in the compressed pool come from there;
+ * each run of the others is read with a single disk command. */
+void
+swap_readv (swap_slot_t slot, void *const kvas[], size_t cnt) {
+	struct disk_iovec iov[SWAP_IO_MAX];
+	bool in_pool[SWAP_IO_MAX];
+	size_t i, j;
+
+	ASSERT (cnt <= SWAP_IO_MAX);
+
+	for (i = 0; i < cnt; i++)
+		in_pool[i] = zswap_load (slot + i, kvas[i]);
+
+	for (i = 0; i < cnt; i = j) {
+		for (j = i; j < cnt && !in_pool[j]; j++) {
+			iov[j - i].buffer = kvas[j];
+			iov[j - i].sector_cnt = SECTORS_PER_SLOT;
+		}
+		if (j == i) {
+			j++;
+			continue;
+		}
+		disk_readv (swap_disk, (slot + i) * SECTORS_PER_SLOT, iov, j - i);
+		read_page_cnt += j - i;
+		read_cmd_cnt++;
+	}
+}
+
+/* Reads the page in SLOT into KVA. */
+void
+swap_read (swap_slot_t slot, void *kva) {
+	swap_readv (slot, &kva, 1);
+}
+
+/* Writes the pages queued on PLUG, one disk command per run of
+ * consecutive slots, and empties it. */
+static void
+plug_flush (struct swap_plug *plug) {
+	struct disk_iovec iov[SWAP_IO_MAX];
+	size_t i, j;
+
+	/* Sort by slot.  There are at most SWAP_IO_MAX of them, so
+	 * insertion sort will do. */
+	for (i = 1; i < plug->cnt; i++)
+		for (j = i; j > 0 && plug->slots[j - 1] > plug->slots[j]; j--) {
+			swap_slot_t slot = plug->slots[j];
+			const void *kva = plug->kvas[j];
+			plug->slots[j] = plug->slots[j - 1];
+			plug->kvas[j] = plug->kvas[j - 1];
+			plug->slots[j - 1] = slot;
+			plug->kvas[j - 1] = kva;
+		}
+
+	for (i = 0; i < plug->cnt; i = j) {
+		for (j = i; j < plug->cnt && plug->slots[j] == plug->slots[i] + (j - i); j++) {
+			iov[j - i].buffer = (void *) plug->kvas[j];
+			iov[j - i].sector_cnt = SECTORS_PER_SLOT;
+		}
+		disk_writev (swap_disk, plug->slots[i] * SECTORS_PER_SLOT, iov, j - i);
+		write_cmd_cnt++;
+	}
+	write_page_cnt += plug->cnt;
+	plug->cnt = 0;
+}
+
+/* Writes the page at KVA to SLOT: into the compressed pool if it
+ * will go, otherwise to disk.  While the calling thread has a plug
+ * in, a disk write is only queued, and KVA must stay intact until
+ * swap_unplug(). */
+void
+swap_write (swap_slot_t slot, const void *kva) {
+	if (zswap_store (slot, kva))
+		return;
+
+	if (active_plug != NULL && plug_owner == thread_current ()) {
+		if (active_plug->cnt == SWAP_IO_MAX)
+			plug_flush (active_plug);
+		active_plug->slots[active_plug->cnt] = slot;
+		active_plug->kvas[active_plug->cnt++] = kva;
+		return;
+	}
+	swap_writeback (slot, kva);
+}
+
+/* Writes the page at KVA to SLOT on disk right away, bypassing the
+ * compressed pool and any plug.  For the pool's own writeback. */
+void
+swap_writeback (swap_slot_t slot, const void *kva) {
+	struct swap_plug plug;
+
+	plug.cnt = 1;
+	plug.slots[0] = slot;
+	plug.kvas[0] = kva;
+	plug_flush (&plug);
+}
+
+/* Starts queueing the calling thread's swap writes on PLUG, so that
+ * a batch of evictions goes to disk as a few large writes.  The
+ * caller must keep other threads from swapping out meanwhile. */
+void
+swap_plug (struct swap_plug *plug) {
+	ASSERT (active_plug == NULL);
+
+	plug->cnt = 0;
+	active_plug = plug;
+	plug_owner = thread_current ();
+}
+
+/* Writes out everything queued on PLUG and stops queueing. */
+void
+swap_unplug (struct swap_plug *plug) {
+	ASSERT (active_plug == plug);
+
+	plug_flush (plug);
+	active_plug = NULL;
+	plug_owner = NULL;
+}
+
+/* Prints swap statistics. */
+void
+swap_print_stats (void) {
+	printf ("Swap: %zu/%zu slots used, %llu clusters (%llu from freed "
+			"extents), %llu single slots\n",
+			used_cnt, slot_cnt, cluster_cnt, extent_hit_cnt, single_cnt);
+	printf ("Swap I/O: %llu pages in %llu reads, %llu pages in %llu writes\n",
+			read_page_cnt, read_cmd_cnt, write_page_cnt, write_cmd_cnt);
+	zswap_print_stats ();
+}
@@ -2,4 +2,7 @@ vm_SRC = vm/vm.c          # Main api proxy
 vm_SRC += vm/uninit.c     # Uninitialized page
 vm_SRC += vm/anon.c       # Anonymous page
 vm_SRC += vm/file.c       # File mapped page
+vm_SRC += vm/swap.c       # Swap slots
+vm_SRC += vm/zswap.c      # Compressed swap pool
 vm_SRC += vm/inspect.c    # Testing utility
+vm_SRC += vm/vma.c        # Virtual memory areas
@@ -10,6 +10,8 @@
 
 #include "vm/vm.h"
 #include "vm/uninit.h"
+#include <string.h>
+#include "threads/vaddr.h"
 
 static bool uninit_initialize(struct page *page, void *kva);
 static void uninit_destroy(struct page *page);
@@ -22,24 +24,37 @@ static const struct page_operations uninit_ops = {
 		.type = VM_UNINIT,
 };
 
-/* DO NOT MODIFY this function */
-// 인자로 받은 VM 초기화 함수, 페이지 타입, 페이지 초기화 함수를 PAGE 멤버에 채워준다.
+// 인자로 받은 VM 초기화 함수, 페이지 타입을 PAGE 멤버에 채워준다.
+// 페이지 초기화 함수는 따로 저장하지 않고 타입에서 고른다 (page_initializer()).
 void uninit_new(struct page *page, void *va, vm_initializer *init,
-								enum vm_type type, void *aux,
-								bool (*initializer)(struct page *, enum vm_type, void *)) {
+								enum vm_type type, void *aux) {
 	ASSERT(page != NULL);
 	*page = (struct page){
 			.operations = &uninit_ops,
 			.va = va,
 			.frame = NULL, /* no frame for now */
+			.type = type,
 			.uninit = (struct uninit_page){
 					.init = init,
-					.type = type,
 					.aux = aux,
-					.page_initializer = initializer,
 			}};
 }
 
+/* Initializes PAGE as the page object of its type, with KVA. */
+static bool
+page_initializer (struct page *page, void *kva) {
+	switch (VM_TYPE (page->type)) {
+		case VM_ANON:
+			return anon_initializer (page, page->type, kva);
+		case VM_FILE:
+			return file_backed_initializer (page, page->type, kva);
+		case VM_PAGE_CACHE:
+			return page_cache_initializer (page, page->type, kva);
+		default:
+			NOT_REACHED ();
+	}
+}
+
 /* Initalize the page on first fault */
 static bool
 uninit_initialize(struct page *page, void *kva)
@@ -53,7 +68,19 @@ uninit_initialize(struct page *page, void *kva)
 	/* TODO: You may need to fix this function. */
 	// 해당 페이지의 타입에 맞도록 페이지를 초기화한다.
 	// 만약 해당 페이지의 segment가 load되지 않은 상태면 lazy_load 해준다. => init이 lazy_load_segment일때
-	return uninit->page_initializer(page, uninit->type, kva) && (init ? init(page, aux) : true);
+	// 불러올 내용이 없는 익명 페이지는 0으로 채운다. (kva가 없으면 타입만 바꾼다)
+	if (init == NULL && kva != NULL && VM_TYPE (page->type) == VM_ANON)
+		memset (kva, 0, PGSIZE);
+	return page_initializer (page, kva) && (init ? init(page, aux) : true);
+}
+
+/* Turns PAGE into the page object it is to become without loading
+ * anything, for a caller that has filled its frame itself.  The
+ * initializer's AUX is left to the caller. */
+bool
+uninit_transmute (struct page *page) {
+	ASSERT (page->operations == &uninit_ops);
+	return page_initializer (page, NULL);
 }
 
 /* Free the resources hold by uninit_page. Although most of pages are transmuted
@@ -66,10 +93,6 @@ uninit_destroy(struct page *page)
 	struct uninit_page *uninit UNUSED = &page->uninit;
 	/* TODO: Fill this function.
 	 * TODO: If you don't have anything to do, just return. */
-		struct file_info *file_info;
-	if(VM_TYPE(uninit->type) == VM_ANON){
-		file_info = (struct file_info*)uninit->aux;
-		free(file_info);
-	}
+	// aux는 (있다면) 페이지가 속한 VMA이고, VMA tree가 가지고 있다.
 
 }
@@ -3,19 +3,82 @@
 #include "threads/malloc.h"
 #include "vm/vm.h"
 #include "vm/inspect.h"
+#include "vm/swap.h"
 
 #include <hash.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include <syscall-nr.h>
+#include "threads/synch.h"
 #include "threads/vaddr.h"
+#include "threads/interrupt.h"
+#include "devices/timer.h"
 #include "userprog/process.h"
 #include "threads/mmu.h"
 
+/* Frame table: one entry per page of the user pool, at the page's
+ * index in the pool, so a frame is found from its kva directly and
+ * the clock can sweep every process's memory in physical order. */
+static struct frame *frame_table;
+static size_t frame_cnt;
+static uint8_t *frame_base;
+
+/* Protects the frame table, the reverse maps and the clock hand. */
+static struct lock frame_lock;
+
+/* Signalled, with FRAME_LOCK, when a frame being read into the page
+ * cache has been filled and unpinned. */
+static struct condition frame_filled;
+
+/* Two-handed clock: the front hand, HAND_SPREAD frames ahead of
+ * BACK_HAND, clears accessed bits; the back hand evicts the first
+ * frame that has not been accessed again since. */
+static size_t back_hand;
+static size_t hand_spread;
+
+/* Background reclaim.  When a frame allocation leaves fewer than
+ * LOW_WM user pages free, kswapd is woken to evict frames, BATCH at
+ * a time, until HIGH_WM pages are free, so that faults rarely have
+ * to evict anything themselves. */
+#define KSWAPD_BATCH 16
+static size_t low_wm, high_wm;
+static struct semaphore kswapd_sema;
+static bool kswapd_pending;     /* Woken and not done yet. */
+
+/* Shared, read-only backing for anonymous memory that has been
+ * read but never written.  A kernel page, outside the frame table,
+ * so it is never evicted. */
+static void *zero_page;
+
+/* Statistics. */
+static unsigned long long zero_map_cnt;       /* Read faults on zero pages. */
+static unsigned long long zero_cow_cnt;       /* ...later written to. */
+static unsigned long long stack_fault_cnt;    /* Faults that grew a stack. */
+static unsigned long long stack_page_cnt;     /* Pages they mapped. */
+static unsigned long long stack_ahead_cnt;    /* ...ahead of the fault. */
+static unsigned long long kswapd_wake_cnt;    /* kswapd runs. */
+static unsigned long long kswapd_evict_cnt;   /* Frames it freed. */
+static unsigned long long direct_evict_cnt;   /* Frames evicted in faults. */
+static unsigned long long limit_reclaim_cnt;  /* Runs of reclaim over a
+                                                 memory limit... */
+static unsigned long long limit_evict_cnt;    /* ...and pages they evicted. */
+static unsigned long long ksm_pass_cnt;       /* ksmd sweeps finished. */
+static unsigned long long ksm_merge_cnt;      /* Pages moved to an identical
+                                                 frame... */
+static unsigned long long ksm_zero_cnt;       /* ...or to the zero page. */
+static unsigned long long ksm_freed_cnt;      /* Frames freed by merging. */
+static unsigned long long ksm_unshare_cnt;    /* Merged pages copied again
+                                                 on a write. */
+
+static void frame_table_init (void);
+static void kswapd (void *);
+static void wssd (void *);
+static void ksm_start (void);
+
 /* Initializes the virtual memory subsystem by invoking each subsystem's
  * intialize codes. */
 
-struct list frame_table;
-struct list_elem *start;
-
-
 void
 vm_init (void) {
 	vm_anon_init ();
@@ -26,8 +89,13 @@ vm_init (void) {
 	register_inspect_intr ();
 	/* DO NOT MODIFY UPPER LINES. */
 	/* TODO: Your code goes here. */
-	list_init(&frame_table);
-	start = list_begin(&frame_table);
+	frame_table_init ();
+	zero_page = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+	if (vm_ksm_enabled)
+		ksm_start ();
+#ifndef EFILESYS
+	pagecache_init ();
+#endif
 }
 
 /* Get the type of the page. This function is useful if you want to know the
@@ -38,7 +106,7 @@ page_get_type (struct page *page) {
 	int ty = VM_TYPE (page->operations->type);
 	switch (ty) {
 		case VM_UNINIT:
-			return VM_TYPE (page->uninit.type);
+			return VM_TYPE (page->type);
 		default:
 			return ty;
 	}
@@ -48,6 +116,7 @@ page_get_type (struct page *page) {
 static struct frame *vm_get_victim (void);
 static bool vm_do_claim_page (struct page *page);
 static struct frame *vm_evict_frame (void);
+static void kswapd_wake (void);
 
 /* Create the pending page object with initializer. If you want to create a
  * page, do not create it directly and make it through this function or
@@ -68,21 +137,14 @@ vm_alloc_page_with_initializer (enum vm_type type, void *upage, bool writable,
 		 * TODO: should modify the field after calling the uninit_new. */
 
 		/* --------------- Project 3 --------------- */
-		bool (*initializer)(struct page *, enum vm_type, void *);
-		
-		switch (VM_TYPE(type)) {
-			case VM_ANON:
-				initializer = anon_initializer;
-				break;
-			case VM_FILE:
-				initializer = file_backed_initializer;
-				break;
-		}
-
+		// 초기화 함수는 uninit 페이지가 타입을 보고 고른다.
 		struct page *new_page = malloc(sizeof(struct page));
-		uninit_new (new_page, upage, init, type, aux, initializer);
+		if (new_page == NULL)
+			return false;
+		uninit_new (new_page, upage, init, type, aux);
 
 		new_page->writable = writable;
+		new_page->owner = thread_current ();
 		// new_page->page_cnt = -1;
 
 		/* TODO: Insert the page into the spt. */
@@ -94,136 +156,1388 @@ err:
 }
 
 /* Find VA from spt and return page. On error, return NULL. */
+/* 가상 페이지 번호를 키로 radix tree를 따라가기만 하므로 할당이 없다. */
 struct page *
 spt_find_page (struct supplemental_page_table *spt UNUSED, void *va UNUSED) {
 	/* --------------- Project 3 --------------- */
-	struct page *page = (struct page*)malloc(sizeof(struct page));
-	page->va = pg_round_down(va);
-
-	struct hash_elem *e;
-	e = hash_find(&spt->spt_table, &page->hash_elem);
-	
-	free(page);
-	
-	if (e == NULL) {
+	if (!is_user_vaddr (va)) {
 		return NULL;
 	}
-
-	return hash_entry(e, struct page, hash_elem);
+	return radix_lookup (&spt->spt_table, pg_no (va));
 	/* ----------------------------------------- */
-
-	// return page;
 }
 
 /* Insert PAGE into spt with validation. */
 bool
 spt_insert_page (struct supplemental_page_table *spt UNUSED,
 		struct page *page UNUSED) {
-	int succ = false;
 	/* TODO: Fill this function. */
-	struct hash_elem *e = hash_find(&spt->spt_table, &page->hash_elem);
-	
-	if (e != NULL) {
-		return succ;
-	}
-
-	hash_insert(&spt->spt_table, &page->hash_elem);
-	
-	return succ = true;
-
-	return succ;
+	// 이미 같은 주소의 페이지가 있으면 false
+	return radix_insert (&spt->spt_table, pg_no (page->va), page);
 }
 
 void
 spt_remove_page (struct supplemental_page_table *spt, struct page *page) {
-	hash_delete(&spt->spt_table, &page->hash_elem);
+	radix_delete (&spt->spt_table, pg_no (page->va));
 	vm_dealloc_page (page);
+}
+
+/* Returns true if ADDR is page-aligned and the LENGTH bytes at ADDR,
+ * of which there is at least one, all lie in areas of SPT.  Takes one
+ * lookup per area, not per page. */
+bool
+spt_range_mapped (struct supplemental_page_table *spt, void *addr,
+		size_t length) {
+	if (pg_ofs (addr) != 0 || length == 0 || !is_user_vaddr (addr)
+			|| length > (uint64_t) USER_STACK - (uint64_t) addr)
+		return false;
+	for (void *va = addr; va < addr + length; ) {
+		struct vma *vma = vma_find (&spt->vmas, va);
+
+		if (vma == NULL)
+			return false;
+		va = vma->end;
+	}
 	return true;
 }
 
+/* Returns the page table PAGE is mapped in: its owner's, or a null
+ * pointer for a page cache page, which is in none. */
+uint64_t *
+page_pml4 (const struct page *page) {
+	return page->owner != NULL ? page->owner->pml4 : NULL;
+}
+
+/* ---- Frames and their reverse map ---- */
+
+/* Allocates the frame table, sized to the user pool. */
+static void
+frame_table_init (void) {
+	size_t bytes;
+
+	frame_base = palloc_user_pool_range (&frame_cnt);
+	bytes = frame_cnt * sizeof *frame_table;
+	frame_table = palloc_get_multiple (PAL_ASSERT | PAL_ZERO,
+			DIV_ROUND_UP (bytes, PGSIZE));
+	lock_init (&frame_lock);
+	cond_init (&frame_filled);
+	back_hand = 0;
+	hand_spread = frame_cnt / 4 + 1;
+
+	low_wm = palloc_user_free_cnt () / 64 + KSWAPD_BATCH;
+	high_wm = 2 * low_wm;
+	sema_init (&kswapd_sema, 0);
+	thread_create ("kswapd", PRI_DEFAULT, kswapd, NULL);
+	thread_create ("wssd", PRI_DEFAULT, wssd, NULL);
+}
+
+/* Returns the frame table entry for user page KVA. */
+static struct frame *
+frame_of (void *kva) {
+	size_t idx = pg_no (kva) - pg_no (frame_base);
+
+	ASSERT (idx < frame_cnt);
+	return &frame_table[idx];
+}
+
+/* Starts using FRAME for user page KVA.  The frame is pinned until
+ * its caller has filled it. */
+static void
+frame_init (struct frame *frame, void *kva) {
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+	ASSERT (frame->kva == NULL);
+
+	frame->kva = kva;
+	frame->maps = NULL;
+	frame->ref_cnt = 0;
+	frame->pinned = true;
+	frame->referenced = false;
+	frame->ksm = false;
+	frame->ksm_sum = 0;
+}
+
+/* Adds DELTA to the count of resident pages of PAGE's owner. */
+static void
+account_resident (struct page *page, int delta) {
+	struct vm_usage *usage;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	if (page->owner == NULL)
+		return;
+	usage = &page->owner->spt.usage;
+	if (page_get_type (page) == VM_FILE)
+		usage->file += delta;
+	else
+		usage->anon += delta;
+}
+
+/* Makes PAGE one of the pages mapping FRAME. */
+static void
+frame_link (struct frame *frame, struct page *page) {
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	page->next_map = frame->maps;
+	frame->maps = page;
+	frame->ref_cnt++;
+	page->frame = frame;
+	account_resident (page, 1);
+}
+
+/* Takes PAGE off its frame's reverse map.  The map is a singly
+ * linked list, to keep struct page small; a frame rarely has more
+ * than a few pages. */
+static void
+frame_unlink (struct page *page) {
+	struct frame *frame = page->frame;
+	struct page **p;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	for (p = &frame->maps; *p != page; p = &(*p)->next_map)
+		ASSERT (*p != NULL);
+	*p = page->next_map;
+	frame->ref_cnt--;
+	page->frame = NULL;
+	account_resident (page, -1);
+}
+
+/* Returns FRAME, which no page maps any more, to the user pool. */
+static void
+frame_free (struct frame *frame) {
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+	ASSERT (frame->ref_cnt == 0);
+
+	palloc_free_page (frame->kva);
+	frame->kva = NULL;
+	frame->pinned = false;
+}
+
+/* Unmaps PAGE, which is being destroyed, and lets go of its
+ * frame.  The frame is freed when PAGE was its last user. */
+void
+vm_frame_release (struct page *page) {
+	struct frame *frame;
+
+	lock_acquire (&frame_lock);
+	frame = page->frame;
+	if (frame != NULL) {
+		/* A page cache page is in no page table. */
+		if (page->owner != NULL)
+			pml4_clear_page (page_pml4 (page), page->va);
+		frame_unlink (page);
+		if (frame->ref_cnt == 0)
+			frame_free (frame);
+	}
+	else if (vm_page_maps_zero (page)) {
+		/* Or pml4_destroy() would free the zero page. */
+		pml4_clear_page (page_pml4 (page), page->va);
+	}
+	lock_release (&frame_lock);
+}
+
+/* Clears the accessed bit of PAGE, a page in memory, and returns
+ * how many pages it stood for: 0 if it was clear, 1, or HPG_PAGES
+ * for a page of a 2 MB mapping, whose bit is in the PDE and shared
+ * by the whole block.  The other frames of such a block are marked
+ * referenced, so that they keep the bit for the clock; the block is
+ * aged as one.  Changes to the page table BATCH, which may be null,
+ * is for are left to BATCH. */
+static size_t
+page_test_and_clear_accessed (struct page *page, struct tlb_batch *batch) {
+	uint64_t *pml4 = page_pml4 (page);
+	uint64_t *pte;
+	size_t cnt = 1;
+
+	if (pml4 == NULL)
+		return 0;
+	pte = pml4e_walk (pml4, (uint64_t) page->va, 0);
+	if (pte == NULL || (*pte & PTE_A) == 0)
+		return 0;
+
+	if (is_huge_pte (pte)) {
+		uint8_t *block = (uint8_t *) page->frame->kva
+			- ((uint8_t *) page->va - (uint8_t *) hpg_round_down (page->va));
+
+		for (size_t i = 0; i < HPG_PAGES; i++) {
+			struct frame *frame = frame_of (block + i * PGSIZE);
+			if (frame != page->frame && page->advice != MADV_SEQUENTIAL)
+				frame->referenced = true;
+		}
+		cnt = HPG_PAGES;
+	}
+	pml4_set_accessed_batch (pml4, page->va, false,
+			batch != NULL && pml4 == batch->pml4 ? batch : NULL);
+	return cnt;
+}
+
+/* Returns true if any page mapping FRAME has been accessed since
+ * the last sweep, as told by their accessed bits or by the working
+ * set sampler that cleared them, and clears both.  Changes to the
+ * page table BATCH is for are left to BATCH. */
+static bool
+frame_test_and_clear_accessed (struct frame *frame, struct tlb_batch *batch) {
+	bool accessed = frame->referenced;
+
+	frame->referenced = false;
+	for (struct page *page = frame->maps; page != NULL;
+			page = page->next_map) {
+		/* Memory read in order is not read again: reclaim
+		 * behind it. */
+		if (page_test_and_clear_accessed (page, batch) != 0
+				&& page->advice != MADV_SEQUENTIAL)
+			accessed = true;
+	}
+	return accessed;
+}
+
+/* Returns true if FRAME is in use, mapped, and not pinned. */
+static bool
+frame_evictable (const struct frame *frame) {
+	return frame->kva != NULL && !frame->pinned && frame->ref_cnt > 0;
+}
+
 /* Get the struct frame, that will be evicted. */
+/* 모든 프로세스의 프레임을 물리 주소 순서로 도는 two-handed clock.
+ * 앞 바늘이 accessed bit을 지우고, 뒤 바늘은 그 사이 다시 접근되지
+ * 않은 프레임을 고른다.  접근된 프레임은 한 번 더 기회를 얻는다. */
 static struct frame *
 vm_get_victim (void) {
+	/* accessed bit을 지운 페이지들의 TLB는 sweep이 끝날 때 한 번에 비운다. */
+	struct tlb_batch batch;
 	struct frame *victim = NULL;
-	/* TODO: The policy for eviction is up to you. */
-
-	struct thread *curr = thread_current();
-	struct list_elem *e = start;
-
-	for (start = e; start != list_end(&frame_table); start = list_next(start)) {
-		victim = list_entry(start, struct frame, frame_elem);
-		// pml4_is_accessed (uint64_t *pml4, const void *vpage)
-		// 1인경우
-		if (pml4_is_accessed(curr->pml4, victim->page->va)){
-			pml4_set_accessed(curr->pml4, victim->page->va, 0);
-		} else {
-			return victim;
-		}
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	tlb_batch_init (&batch, thread_current ()->pml4);
+	for (size_t step = 0; step < 2 * frame_cnt && victim == NULL; step++) {
+		struct frame *front = &frame_table[(back_hand + hand_spread) % frame_cnt];
+		struct frame *back = &frame_table[back_hand];
+
+		back_hand = (back_hand + 1) % frame_cnt;
+		if (frame_evictable (front))
+			frame_test_and_clear_accessed (front, &batch);
+		if (frame_evictable (back)
+				&& !frame_test_and_clear_accessed (back, &batch))
+			victim = back;
 	}
+	tlb_batch_flush (&batch);
 
-	for (start = list_begin(&frame_table); start != e; start = list_next(start)) {
-		victim = list_entry(start, struct frame, frame_elem);
-		if (pml4_is_accessed(curr->pml4, victim->page->va)) {
-			pml4_set_accessed(curr->pml4, victim->page->va, 0);
-		} else {
-			return victim;
-		}
+	/* Everything kept being touched: take the next mapped frame. */
+	for (size_t step = 0; step < frame_cnt && victim == NULL; step++) {
+		struct frame *back = &frame_table[back_hand];
+
+		back_hand = (back_hand + 1) % frame_cnt;
+		if (frame_evictable (back))
+			victim = back;
 	}
 	return victim;
 }
 
+/* Swaps out every page mapping VICTIM and leaves it pinned with
+ * none.  Returns false if a page could not be written out (swap is
+ * full): that page and the ones after it keep VICTIM, which is
+ * unpinned again. */
+static bool
+frame_evict (struct frame *victim) {
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	victim->pinned = true;
+	while (victim->maps != NULL) {
+		struct page *page = victim->maps;
+		if (!swap_out (page)) {
+			victim->pinned = false;
+			return false;
+		}
+		frame_unlink (page);
+	}
+	return true;
+}
+
 /* Evict one page and return the corresponding frame.
  * Return NULL on error.*/
+/* 프레임을 공유하는 모든 페이지를 함께 내보낸다.  스왑이 가득 차서
+ * 내보낼 수 없는 프레임은 건너뛰고 다음 희생자를 찾는다. */
 static struct frame *
 vm_evict_frame (void) {
-	struct frame *victim UNUSED = vm_get_victim ();
-	/* TODO: swap out the victim and return the evicted frame. */
-	swap_out(victim->page);
-	return victim;
+	for (size_t tries = 0; tries < frame_cnt; tries++) {
+		struct frame *victim = vm_get_victim ();
+
+		if (victim == NULL)
+			return NULL;
+		if (frame_evict (victim))
+			return victim;
+	}
+	return NULL;
 }
 
 /* palloc() and get frame. If there is no available page, evict the page
  * and return it. This always return valid address. That is, if the user pool
  * memory is full, this function evicts the frame to get the available memory
  * space.*/
+/* 돌려주는 프레임은 pinned 상태이므로 채운 뒤 pinned를 풀어야 한다. */
 static struct frame *
 vm_get_frame (void) {
 	/* TODO: Fill this function. */
-	// struct frame *frame = NULL;
-	struct frame *frame = (struct frame *)malloc(sizeof(struct frame));
-	frame->kva = palloc_get_page(PAL_USER); //USER POOL에서 커널 가상 주소 공간으로 1page 할당
+	void *kva = palloc_get_page(PAL_USER); //USER POOL에서 커널 가상 주소 공간으로 1page 할당
+	struct frame *frame;
 
 	/* if 프레임이 꽉 차서 할당받을 수 없다면 페이지 교체 실시
-	   else 성공했다면 frame 구조체 커널 주소 멤버에 위에서 할당받은 메모리 커널 주소 넣기 */
-	if (frame->kva == NULL)
-	{
+	   else 성공했다면 frame table에서 해당 페이지의 원소를 쓴다 */
+	lock_acquire (&frame_lock);
+	if (kva == NULL) {
 		frame = vm_evict_frame();
-		frame->page = NULL; 
-
-		return frame;
+		if (frame == NULL)
+			PANIC ("no frame to evict");
+		ASSERT (frame->ref_cnt == 0);
+		direct_evict_cnt++;
+	}
+	else {
+		frame = frame_of (kva);
+		frame_init (frame, kva);
 	}
-	list_push_back (&frame_table, &frame->frame_elem);
-	frame->page = NULL;
+	lock_release (&frame_lock);
+	kswapd_wake ();
 
 	ASSERT (frame != NULL);
-	ASSERT (frame->page == NULL);
 	return frame;
 }
 
-/* Growing the stack. */
+/* Returns a pinned frame, or a null pointer instead of evicting
+ * anything if free frames are scarce.  For speculative use. */
+struct frame *
+vm_frame_try_alloc (void) {
+	struct frame *frame = NULL;
+	void *kva;
+
+	if (palloc_user_free_cnt () <= low_wm)
+		return NULL;
+	kva = palloc_get_page (PAL_USER);
+	if (kva != NULL) {
+		lock_acquire (&frame_lock);
+		frame = frame_of (kva);
+		frame_init (frame, kva);
+		lock_release (&frame_lock);
+	}
+	return frame;
+}
+
+/* Gives back FRAME, a pinned frame from vm_frame_try_alloc() that
+ * went unused. */
+void
+vm_frame_discard (struct frame *frame) {
+	lock_acquire (&frame_lock);
+	frame_free (frame);
+	lock_release (&frame_lock);
+}
+
+/* Maps PAGE to FRAME, a pinned frame already holding PAGE's
+ * contents, and unpins it.  Returns false, freeing FRAME, if PAGE
+ * could not be mapped. */
+bool
+vm_frame_map (struct page *page, struct frame *frame) {
+	bool success;
+
+	lock_acquire (&frame_lock);
+	frame_link (frame, page);
+	success = pml4_set_page (page_pml4 (page), page->va, frame->kva, page->writable);
+	if (!success) {
+		frame_unlink (page);
+		frame_free (frame);
+	}
+	else
+		frame->pinned = false;
+	lock_release (&frame_lock);
+	return success;
+}
+
+/* ---- Frames of the page cache ----
+ *
+ * A page cache page (see filesys/page_cache.c) belongs to no process
+ * and is in no page table; the pages of every mapping of it are
+ * linked to its frame, so eviction writes it back once and unmaps
+ * them all. */
+
+/* Makes PAGE, which no page table maps, the user of FRAME, a pinned
+ * frame from vm_frame_try_alloc() that the caller is about to fill.
+ * Returns false if PAGE has a frame already. */
+bool
+vm_frame_link (struct page *page, struct frame *frame) {
+	bool success;
+
+	lock_acquire (&frame_lock);
+	success = page->frame == NULL;
+	if (success)
+		frame_link (frame, page);
+	lock_release (&frame_lock);
+	return success;
+}
+
+/* Unpins FRAME, now filled, and wakes whoever waits for it. */
+void
+vm_frame_unpin (struct frame *frame) {
+	lock_acquire (&frame_lock);
+	frame->pinned = false;
+	cond_broadcast (&frame_filled, &frame_lock);
+	lock_release (&frame_lock);
+}
+
+/* Waits until PAGE's frame, if any, has been filled.  Returns false
+ * if PAGE is not in memory. */
+static bool
+frame_wait_filled (struct page *page) {
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	while (page->frame != NULL && page->frame->pinned)
+		cond_wait (&frame_filled, &frame_lock);
+	return page->frame != NULL;
+}
+
+/* Brings OWNER, a page no page table maps, into memory unless it is
+ * there, and returns with the frame lock held.  Returns false,
+ * without the lock, if OWNER could not be read in. */
+static bool
+owner_lock_resident (struct page *owner) {
+	struct frame *frame;
+
+	for (;;) {
+		lock_acquire (&frame_lock);
+		if (frame_wait_filled (owner))
+			return true;
+		lock_release (&frame_lock);
+
+		/* Getting a frame may evict, and OWNER with it; look again. */
+		frame = vm_get_frame ();
+		lock_acquire (&frame_lock);
+		if (owner->frame != NULL) {
+			frame_free (frame);
+			lock_release (&frame_lock);
+			continue;
+		}
+		frame_link (frame, owner);
+		lock_release (&frame_lock);
+
+		if (!swap_in (owner, frame->kva)) {
+			lock_acquire (&frame_lock);
+			frame_unlink (owner);
+			frame_free (frame);
+			cond_broadcast (&frame_filled, &frame_lock);
+			lock_release (&frame_lock);
+			return false;
+		}
+		vm_frame_unpin (frame);
+	}
+}
+
+/* Maps PAGE, which has no frame, to the frame of OWNER, a page no
+ * page table maps, reading OWNER in first if needed. */
+bool
+vm_claim_shared (struct page *page, struct page *owner) {
+	bool success;
+
+	if (!owner_lock_resident (owner))
+		return false;
+	frame_link (owner->frame, page);
+	success = pml4_set_page (page_pml4 (page), page->va, owner->frame->kva,
+			page->writable);
+	if (!success)
+		frame_unlink (page);
+	lock_release (&frame_lock);
+	return success;
+}
+
+/* Like vm_claim_shared(), but does nothing and returns false unless
+ * OWNER is in memory already. */
+bool
+vm_map_shared (struct page *page, struct page *owner) {
+	bool success = false;
+
+	lock_acquire (&frame_lock);
+	if (page->frame == NULL && owner->frame != NULL && !owner->frame->pinned) {
+		frame_link (owner->frame, page);
+		success = pml4_set_page (page_pml4 (page), page->va, owner->frame->kva,
+				page->writable);
+		if (!success)
+			frame_unlink (page);
+	}
+	lock_release (&frame_lock);
+	return success;
+}
+
+/* Returns true if PAGE's frame is in memory and filled.  A frame
+ * still being read in holds nothing written yet. */
+static bool
+frame_filled_now (struct page *page) {
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	return page->frame != NULL && !page->frame->pinned;
+}
+
+/* Lets PAGE's swap_out write it back now, if it is in memory, as
+ * eviction would, but keeps it there. */
+void
+vm_frame_flush (struct page *page) {
+	lock_acquire (&frame_lock);
+	if (frame_filled_now (page))
+		swap_out (page);
+	lock_release (&frame_lock);
+}
+
+/* Copies SIZE bytes at offset OFS of PAGE's contents to BUFFER, or
+ * from BUFFER if WRITE, if PAGE is in memory.  Returns false, doing
+ * nothing, if it is not, or is still being read in; waiting for that
+ * could deadlock with a writer holding up the read. */
+bool
+vm_page_copy (struct page *page, size_t ofs, void *buffer, size_t size,
+		bool write) {
+	bool resident;
+
+	ASSERT (ofs + size <= PGSIZE);
+
+	lock_acquire (&frame_lock);
+	resident = frame_filled_now (page);
+	if (resident && write)
+		memcpy (page->frame->kva + ofs, buffer, size);
+	else if (resident)
+		memcpy (buffer, page->frame->kva + ofs, size);
+	lock_release (&frame_lock);
+	return resident;
+}
+
+/* Wakes kswapd if free user pages have fallen below the low
+ * watermark. */
+static void
+kswapd_wake (void) {
+	if (!kswapd_pending && palloc_user_free_cnt () < low_wm) {
+		kswapd_pending = true;
+		sema_up (&kswapd_sema);
+	}
+}
+
+/* Frees up to KSWAPD_BATCH frames, stopping at the high watermark.
+ * Returns the number freed. */
+static size_t
+kswapd_reclaim_batch (void) {
+	struct frame *victims[KSWAPD_BATCH];
+	struct swap_plug plug;
+	size_t freed = 0;
+
+	/* Swap writes are queued and go out together, as a few large
+	 * writes, before the frames are let go. */
+	lock_acquire (&frame_lock);
+	swap_plug (&plug);
+	while (freed < KSWAPD_BATCH
+			&& palloc_user_free_cnt () + freed < high_wm) {
+		struct frame *victim = vm_evict_frame ();
+		if (victim == NULL)
+			break;
+		victims[freed++] = victim;
+	}
+	swap_unplug (&plug);
+	for (size_t i = 0; i < freed; i++)
+		frame_free (victims[i]);
+	kswapd_evict_cnt += freed;
+	lock_release (&frame_lock);
+	return freed;
+}
+
+/* Background reclaim thread.  The lock is dropped between batches
+ * so that faults can take the frames as they come free. */
+static void
+kswapd (void *aux UNUSED) {
+	for (;;) {
+		sema_down (&kswapd_sema);
+		kswapd_wake_cnt++;
+		while (palloc_user_free_cnt () < high_wm
+				&& kswapd_reclaim_batch () > 0)
+			continue;
+		kswapd_pending = false;
+	}
+}
+
+/* ---- Memory accounting ---- */
+
+/* Print each process's memory use when it exits (-memstat). */
+bool vm_memstat_on_exit;
+
+/* Working set sampling.  Every WSS_INTERVAL ticks wssd sweeps the
+ * frame table, clearing the accessed bits it finds set and crediting
+ * each process with its pages that had them: what it touched during
+ * the interval, which is taken as its working set.  The frame keeps
+ * a note of the bits for the clock.  Counts are kept by pass number,
+ * so that a process need not be visited to start on a new pass. */
+#define WSS_INTERVAL (TIMER_FREQ / 2)
+#define WSS_BATCH 64                  /* Frames per hold of the lock. */
+static unsigned wss_pass;             /* Current or last pass, from 1. */
+static bool wss_sweeping;             /* WSS_PASS is not done yet. */
+
+/* Counts CNT pages of USAGE's process seen accessed in this pass. */
+static void
+wss_credit (struct vm_usage *usage, size_t cnt) {
+	if (usage->wss_pass != wss_pass) {
+		usage->wss = usage->wss_pass + 1 == wss_pass ? usage->wss_cnt : 0;
+		usage->wss_cnt = 0;
+		usage->wss_pass = wss_pass;
+	}
+	usage->wss_cnt += cnt;
+}
+
+/* Returns USAGE's count from the last complete pass. */
+static size_t
+wss_estimate (const struct vm_usage *usage) {
+	unsigned done = wss_sweeping ? wss_pass - 1 : wss_pass;
+
+	if (usage->wss_pass == done)
+		return usage->wss_cnt;
+	if (usage->wss_pass == done + 1)
+		return usage->wss;
+	return 0;
+}
+
+/* Credits the owners of the pages mapping FRAME that have been
+ * accessed, and moves their accessed bits into the frame. */
 static void
-vm_stack_growth (void *addr UNUSED) {
+wss_sample_frame (struct frame *frame) {
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	if (!frame_evictable (frame))
+		return;
+	for (struct page *page = frame->maps; page != NULL;
+			page = page->next_map) {
+		/* A 2 MB page is counted whole, at the first of its frames
+		 * to be looked at. */
+		size_t cnt = page_test_and_clear_accessed (page, NULL);
+
+		if (cnt != 0) {
+			wss_credit (&page->owner->spt.usage, cnt);
+			if (page->advice != MADV_SEQUENTIAL)
+				frame->referenced = true;
+		}
+	}
+}
+
+/* Working set sampler thread. */
+static void
+wssd (void *aux UNUSED) {
+	for (;;) {
+		timer_sleep (WSS_INTERVAL);
+		wss_pass++;
+		wss_sweeping = true;
+		for (size_t base = 0; base < frame_cnt; base += WSS_BATCH) {
+			lock_acquire (&frame_lock);
+			for (size_t i = base; i < base + WSS_BATCH && i < frame_cnt; i++)
+				wss_sample_frame (&frame_table[i]);
+			lock_release (&frame_lock);
+		}
+		wss_sweeping = false;
+	}
+}
+
+/* Adds DELTA to the count of swapped-out pages of PAGE's owner. */
+void
+vm_account_swap (struct page *page, int delta) {
+	enum intr_level old_level;
+
+	if (page->owner == NULL)
+		return;
+	/* Counted by the owner and by evicting threads alike. */
+	old_level = intr_disable ();
+	page->owner->spt.usage.swap += delta;
+	intr_set_level (old_level);
+}
+
+/* Fills in STAT with the memory use of process T. */
+void
+vm_memstat (struct thread *t, struct memstat *stat) {
+	const struct vm_usage *usage = &t->spt.usage;
+
+	stat->anon = usage->anon;
+	stat->file = usage->file;
+	stat->rss = stat->anon + stat->file;
+	stat->swap = usage->swap;
+	stat->wss = wss_estimate (usage);
+	stat->limit = t->mem_limit;
+}
+
+/* ---- Memory limits ----
+ *
+ * A process may be held to a number of resident pages.  One at its
+ * limit evicts pages of its own before it takes another frame, so
+ * that it pages against itself instead of pushing every other
+ * process out to swap.  The limit is soft: pages that are pinned or
+ * shared copy-on-write are left alone, and if nothing else can go
+ * the process goes over. */
+
+/* Most resident pages of a new process, or 0 (-memlimit=KB). */
+size_t vm_mem_limit;
+
+/* Returns true if T has as many resident pages as its limit allows. */
+static bool
+over_mem_limit (const struct thread *t) {
+	const struct vm_usage *usage = &t->spt.usage;
+
+	return t->mem_limit != 0 && usage->anon + usage->file >= t->mem_limit;
+}
+
+/* Returns true if T may take CNT more resident pages within its
+ * limit. */
+static bool
+mem_limit_allows (const struct thread *t, size_t cnt) {
+	const struct vm_usage *usage = &t->spt.usage;
+
+	return t->mem_limit == 0
+		|| usage->anon + usage->file + cnt <= t->mem_limit;
+}
+
+/* Evicts PAGE, a resident page of the current process, and frees
+ * its frame if no other page maps it.  Returns false, doing nothing,
+ * if the frame is pinned or shared copy-on-write, or PAGE could not
+ * be written out.  A page of a file mapping only lets go of the page
+ * cache's frame, as with MADV_DONTNEED. */
+static bool
+evict_own_page (struct page *page) {
+	struct frame *frame = page->frame;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	if (!frame_evictable (frame)
+			|| (VM_TYPE (page->operations->type) != VM_FILE
+				&& frame->ref_cnt > 1))
+		return false;
+	if (!swap_out (page))
+		return false;
+	frame_unlink (page);
+	if (frame->ref_cnt == 0)
+		frame_free (frame);
+	return true;
+}
+
+/* Evicts pages of CURR, the current process, until it is under its
+ * limit.  A clock of its own: the hand goes round CURR's pages in
+ * address order, and a page accessed since it last passed gets
+ * another chance.  Gives up after going round twice. */
+static void
+mem_limit_reclaim (struct thread *curr) {
+	struct radix *table = &curr->spt.spt_table;
+	size_t steps = 2 * radix_size (table) + 1;
+	uint64_t vpn = curr->reclaim_vpn;
+	struct tlb_batch batch;
+
+	limit_reclaim_cnt++;
+	tlb_batch_init (&batch, curr->pml4);
+	lock_acquire (&frame_lock);
+	while (over_mem_limit (curr) && steps-- > 0) {
+		struct page *page = radix_next (table, &vpn);
+
+		if (page == NULL) {
+			vpn = 0;
+			continue;
+		}
+		vpn++;
+		if (page->frame == NULL)
+			continue;
+		if (page_test_and_clear_accessed (page, &batch) != 0
+				|| page->frame->referenced) {
+			page->frame->referenced = false;
+			if (page->advice != MADV_SEQUENTIAL)
+				continue;
+		}
+		if (evict_own_page (page))
+			limit_evict_cnt++;
+	}
+	lock_release (&frame_lock);
+	tlb_batch_flush (&batch);
+	curr->reclaim_vpn = vpn;
+}
+
+/* Holds the current process to PAGES resident pages, or lifts its
+ * limit if PAGES is 0, evicting down to the new limit now.  Returns
+ * false if PAGES is too few to run in. */
+bool
+vm_set_mem_limit (size_t pages) {
+	struct thread *curr = thread_current ();
+
+	if (pages != 0 && pages < VM_MEM_LIMIT_MIN)
+		return false;
+	curr->mem_limit = pages;
+	if (over_mem_limit (curr))
+		mem_limit_reclaim (curr);
+	return true;
+}
+
+/* Prints frame reclaim statistics. */
+void
+vm_print_stats (void) {
+	size_t page_block = malloc_block_size (sizeof (struct page));
+
+	printf ("Page metadata: %zu-byte struct page in a %zu-byte block, "
+			"%zu kB per GB touched\n", sizeof (struct page), page_block,
+			(size_t) (1 << 30) / PGSIZE * page_block / 1024);
+	printf ("Zero page: %llu read faults mapped it, %llu later written\n",
+			zero_map_cnt, zero_cow_cnt);
+	printf ("Stack growth: %llu faults mapped %llu pages, %llu ahead\n",
+			stack_fault_cnt, stack_page_cnt, stack_ahead_cnt);
+	printf ("Reclaim: %llu kswapd runs freed %llu frames, "
+			"%llu evicted in faults, watermarks %zu/%zu\n",
+			kswapd_wake_cnt, kswapd_evict_cnt, direct_evict_cnt,
+			low_wm, high_wm);
+	printf ("Memory limits: %llu reclaims evicted %llu pages\n",
+			limit_reclaim_cnt, limit_evict_cnt);
+	printf ("KSM: %llu passes merged %llu pages, %llu onto the zero page, "
+			"saving %llu frames; %llu unshared by writes\n",
+			ksm_pass_cnt, ksm_merge_cnt, ksm_zero_cnt, ksm_freed_cnt,
+			ksm_unshare_cnt);
+	swap_print_stats ();
+	anon_print_stats ();
+	file_print_stats ();
+	page_cache_print_stats ();
+}
+
+/* Most the user stack grows to for a new process (-stack=KB). */
+size_t vm_stack_limit = VM_STACK_LIMIT_DEFAULT;
+
+/* Pages mapped ahead below a stack fault, from free frames only, so
+ * that a deep recursion does not fault on every page. */
+#define STACK_GROW_AHEAD 8
+
+/* Maps a zeroed page of stack at VA from a free frame, if there is
+ * one without evicting anything.  Returns false if not. */
+static bool
+stack_map_ahead (void *va) {
+	struct frame *frame;
+	struct page *page;
+
+	/* Nor past the process's memory limit. */
+	if (over_mem_limit (thread_current ()))
+		return false;
+	frame = vm_frame_try_alloc ();
+	if (frame == NULL)
+		return false;
+	if (!vm_alloc_page (VM_ANON | VM_STACK, va, true)) {
+		vm_frame_discard (frame);
+		return false;
+	}
+	page = spt_find_page (&thread_current ()->spt, va);
+	memset (frame->kva, 0, PGSIZE);
+	if (!uninit_transmute (page)) {
+		/* Left to be zero-filled on its first fault. */
+		vm_frame_discard (frame);
+		return true;
+	}
+	return vm_frame_map (page, frame);
+}
+
+/* Growing the stack. */
+/* 스택을 ADDR가 있는 페이지까지 한 번에 늘리고 모두 바로 매핑한다.
+ * 그 아래로도 STACK_GROW_AHEAD 페이지까지, 남는 프레임이 있으면 미리
+ * 매핑해 둔다.  프로세스의 한도(stack_limit)는 넘지 않는다. */
+static bool
+vm_stack_growth (void *addr) {
+	struct thread *curr = thread_current ();
+	uint8_t *limit = (uint8_t *) USER_STACK - curr->stack_limit;
+	uint8_t *bottom = pg_round_down (addr);
+	uint8_t *ahead = bottom - STACK_GROW_AHEAD * PGSIZE;
+	uint64_t mapped = stack_page_cnt;
+
 	// stack에 해당하는 anon페이지를 uninit으로 만들고 SPT에 넣어준다.
 	// 물리 메모리와 매핑
-	if (vm_alloc_page(VM_ANON | VM_STACK, addr, 1)) {
-		vm_claim_page(addr);
-		thread_current()->stack_bottom -= PGSIZE;
+	while ((uint8_t *) curr->stack_bottom > bottom) {
+		void *va = curr->stack_bottom - PGSIZE;
+
+		if (!vm_alloc_page (VM_ANON | VM_STACK, va, true) || !vm_claim_page (va))
+			return false;
+		curr->stack_bottom = va;
+		stack_page_cnt++;
+	}
+
+	if (ahead < limit)
+		ahead = limit;
+	while ((uint8_t *) curr->stack_bottom > ahead
+			&& stack_map_ahead (curr->stack_bottom - PGSIZE)) {
+		curr->stack_bottom -= PGSIZE;
+		stack_page_cnt++;
+		stack_ahead_cnt++;
 	}
+
+	if (stack_page_cnt != mapped)
+		stack_fault_cnt++;
+	return true;
 }
 
 /* Handle the fault on write_protected page */
+/* fork 이후 공유 중인(copy-on-write) 프레임에 쓰기가 일어나면
+ * 프레임을 복사해서 PAGE만의 프레임으로 만든다. 마지막 사용자는
+ * 복사 없이 쓰기 권한만 되돌려 받는다. */
 static bool
 vm_handle_wp (struct page *page UNUSED) {
+	if (!page->writable)
+		return false;
+
+	struct frame *frame = vm_get_frame ();
+	struct frame *old;
+	bool success;
+
+	lock_acquire (&frame_lock);
+	old = page->frame;
+	if (old == NULL) {
+		/* Evicted while we got FRAME: its contents are private now. */
+		frame_link (frame, page);
+		lock_release (&frame_lock);
+		success = pml4_set_page (page_pml4 (page), page->va, frame->kva, true)
+			&& swap_in (page, frame->kva);
+	}
+	else if (old->ref_cnt == 1) {
+		/* Every other user is gone; no copy needed. */
+		frame_free (frame);
+		lock_release (&frame_lock);
+		pml4_set_writable (page_pml4 (page), page->va, true);
+		return true;
+	}
+	else {
+		memcpy (frame->kva, old->kva, PGSIZE);
+		if (old->ksm)
+			ksm_unshare_cnt++;
+		frame_unlink (page);
+		frame_link (frame, page);
+		lock_release (&frame_lock);
+		success = pml4_set_page (page_pml4 (page), page->va, frame->kva, true);
+	}
+	frame->pinned = false;
+	return success;
+}
+
+/* ---- Zero page ---- */
+
+/* Returns true if PAGE is anonymous memory whose contents are all
+ * zeros and held nowhere: never touched, or dropped at eviction
+ * because it was all zeros. */
+static bool
+page_is_zero (struct page *page) {
+	enum vm_type type = page->operations->type;
+
+	if (page->frame != NULL)
+		return false;
+	if (VM_TYPE (type) == VM_UNINIT)
+		return VM_TYPE (page->type) == VM_ANON && page->uninit.init == NULL;
+	return VM_TYPE (type) == VM_ANON && page->anon.swap_slot == SWAP_SLOT_NONE;
+}
+
+/* Returns true if PAGE is mapped to the shared zero page. */
+bool
+vm_page_maps_zero (struct page *page) {
+	return page->frame == NULL && page->owner != NULL
+		&& pml4_get_page (page_pml4 (page), page->va) == zero_page;
+}
+
+/* Maps PAGE, which is being read for the first time, to the shared
+ * zero page, read-only.  Returns false, doing nothing, if PAGE is
+ * not all zeros; it then needs a frame of its own. */
+static bool
+vm_map_zero_page (struct page *page) {
+	if (!page_is_zero (page))
+		return false;
+	/* Turn it into an anonymous page; with no kva, this loads
+	 * nothing. */
+	if (VM_TYPE (page->operations->type) == VM_UNINIT && !swap_in (page, NULL))
+		return false;
+	if (!pml4_set_page (page_pml4 (page), page->va, zero_page, false))
+		return false;
+	zero_map_cnt++;
+	return true;
+}
+
+/* Gives PAGE, mapped to the zero page and now being written, a
+ * zeroed frame of its own. */
+static bool
+vm_unmap_zero_page (struct page *page) {
+	pml4_clear_page (page_pml4 (page), page->va);
+	zero_cow_cnt++;
+	return vm_do_claim_page (page);
+}
+
+/* ---- Advice ---- */
+
+/* Reads PAGE in now, unless it is in memory or all zeros. */
+static void
+vm_page_willneed (struct page *page) {
+	if (page->frame == NULL && !page_is_zero (page)
+			&& pml4_get_page (page_pml4 (page), page->va) == NULL)
+		vm_do_claim_page (page);
+}
+
+/* Puts PAGE first in line for reclaim.  A page of a file mapping is
+ * unmapped right away, as its contents stay in the page cache; an
+ * anonymous page loses its accessed bit, so that the clock takes it
+ * ahead of the pages in use. */
+static void
+vm_page_dontneed (struct page *page, struct tlb_batch *batch) {
+	struct frame *frame;
+
+	lock_acquire (&frame_lock);
+	frame = page->frame;
+	if (frame != NULL && !frame->pinned) {
+		if (VM_TYPE (page->operations->type) == VM_FILE) {
+			swap_out (page);
+			frame_unlink (page);
+			if (frame->ref_cnt == 0)
+				frame_free (frame);
+		}
+		else
+			pml4_set_accessed_batch (page_pml4 (page), page->va, false, batch);
+	}
+	lock_release (&frame_lock);
+}
+
+/* Applies ADVICE, one of MADV_*, to the LENGTH bytes of the current
+ * process's memory at ADDR.  SEQUENTIAL and RANDOM stay with the
+ * pages and steer fault-around, read-ahead and reclaim; WILLNEED and
+ * DONTNEED act at once.  Returns false if ADVICE is unknown or the
+ * range is not all in use. */
+bool
+vm_madvise (void *addr, size_t length, int advice) {
+	struct thread *curr = thread_current ();
+	struct tlb_batch batch;
+
+	if (advice < MADV_NORMAL || advice > MADV_DONTNEED
+			|| !spt_range_mapped (&curr->spt, addr, length))
+		return false;
+
+	tlb_batch_init (&batch, curr->pml4);
+	for (void *va = addr; va < addr + length; va += PGSIZE) {
+		struct page *page = spt_find_page (&curr->spt, va);
+
+		/* A page of a file mapping not touched yet is made for advice
+		 * that stays with it or wants it now. */
+		if (page == NULL && advice != MADV_NORMAL && advice != MADV_DONTNEED) {
+			struct vma *vma = vma_find (&curr->spt.vmas, va);
+
+			if (vma != NULL && vma->type == VMA_MMAP)
+				page = file_vma_page (vma, va);
+		}
+		if (page == NULL)
+			continue;
+
+		switch (advice) {
+			case MADV_WILLNEED:
+				vm_page_willneed (page);
+				break;
+			case MADV_DONTNEED:
+				vm_page_dontneed (page, &batch);
+				break;
+			default:
+				page->advice = advice;
+				break;
+		}
+	}
+	tlb_batch_flush (&batch);
+	return true;
+}
+
+/* ---- Transparent huge pages ---- */
+
+/* Back aligned 2 MB blocks of anonymous memory with one 2 MB page
+ * instead of 512 small ones.  Off by default; set by -thp. */
+bool vm_thp_enabled;
+
+/* Returns true if every page of the 2 MB block at BASE is in SPT,
+ * is an anonymous page that has not been loaded yet, and has the
+ * same writability, so the block can be filled in one go. */
+static bool
+huge_block_claimable (struct supplemental_page_table *spt, void *base) {
+	bool writable = false;
+
+	if (!is_user_vaddr (base) || !is_user_vaddr (base + HPGSIZE - 1))
+		return false;
+
+	for (size_t i = 0; i < HPG_PAGES; i++) {
+		struct page *page = spt_find_page (spt, base + i * PGSIZE);
+		if (page == NULL || page->frame != NULL
+				|| VM_TYPE (page->operations->type) != VM_UNINIT
+				|| VM_TYPE (page->type) != VM_ANON)
+			return false;
+		if (i == 0)
+			writable = page->writable;
+		else if (page->writable != writable)
+			return false;
+	}
+	return true;
+}
+
+/* Tries to claim the whole 2 MB block containing ADDR with a
+ * single huge page.  Returns false without side effects if the
+ * block does not qualify or no aligned run of user pages is free;
+ * the caller then falls back to a 4 kB page.
+ *
+ * If loading one of the pages fails, the pages loaded so far are
+ * mapped with ordinary PTEs, the rest go back to being lazy, and
+ * the result tells whether ADDR itself was loaded. */
+static bool
+vm_claim_huge_page (void *addr) {
+	struct thread *curr = thread_current ();
+	void *base = hpg_round_down (addr);
+	size_t fault_idx = (pg_round_down (addr) - base) / PGSIZE;
+	size_t loaded;
+	uint8_t *kva;
+
+	/* A process with a memory limit takes a 2 MB page only if the
+	 * whole of it fits under the limit. */
+	if (!mem_limit_allows (curr, HPG_PAGES)
+			|| !huge_block_claimable (&curr->spt, base))
+		return false;
+	kva = palloc_get_multiple_aligned (PAL_USER, HPG_PAGES, HPG_PAGES);
+	if (kva == NULL)
+		return false;
+	kswapd_wake ();
+
+	for (loaded = 0; loaded < HPG_PAGES; loaded++) {
+		struct page *page = spt_find_page (&curr->spt, base + loaded * PGSIZE);
+		struct frame *frame = frame_of (kva + loaded * PGSIZE);
+
+		lock_acquire (&frame_lock);
+		frame_init (frame, kva + loaded * PGSIZE);
+		frame_link (frame, page);
+		lock_release (&frame_lock);
+		if (!swap_in (page, frame->kva))
+			break;
+	}
+
+	bool writable = spt_find_page (&curr->spt, base)->writable;
+	bool mapped = loaded == HPG_PAGES
+		&& pml4_set_huge_page (curr->pml4, base, kva, writable);
+
+	/* Unless mapped in one go, fall back to small pages for what has
+	 * been loaded.  A page whose load failed holds whatever the frame
+	 * held before, so it loses its frame and stays lazy, like the
+	 * pages after it, whose frames go straight back. */
+	for (size_t i = 0; i < HPG_PAGES; i++) {
+		struct page *page = spt_find_page (&curr->spt, base + i * PGSIZE);
+		if (i < loaded) {
+			if (!mapped)
+				pml4_set_page (curr->pml4, page->va, page->frame->kva, page->writable);
+			page->frame->pinned = false;
+		}
+		else if (i == loaded) {
+			lock_acquire (&frame_lock);
+			frame_unlink (page);
+			frame_free (frame_of (kva + i * PGSIZE));
+			lock_release (&frame_lock);
+		}
+		else
+			palloc_free_page (kva + i * PGSIZE);
+	}
+	return mapped || fault_idx < loaded;
+}
+
+/* ---- Same-page merging ----
+ *
+ * ksmd walks the frame table, a few frames at a time, looking for
+ * anonymous pages with the same contents: after fork, after exec of
+ * the same program, or zero-filled.  A frame whose contents hash the
+ * same as on ksmd's last pass is taken as stable and looked up by
+ * that hash among the stable frames seen so far in this pass.  If an
+ * identical frame turns up, every page of the one is remapped to the
+ * other, read-only, and the frame is freed; an all-zero frame gives
+ * way to the zero page.  A write then faults, and vm_handle_wp() or
+ * vm_unmap_zero_page() give the writer a copy of its own, as after
+ * fork.  Off by default; set by -ksm. */
+
+bool vm_ksm_enabled;
+
+#define KSM_BATCH 32                  /* Frames per hold of the lock... */
+#define KSM_INTERVAL (TIMER_FREQ / 50) /* ...and ticks between them. */
+
+static uint64_t ksm_zero_sum;         /* Hash of a page of zeros. */
+
+/* A stable frame, in the hash table of one pass. */
+struct ksm_node {
+	struct hash_elem elem;
+	uint64_t sum;                       /* Hash of FRAME's contents. */
+	struct frame *frame;
+};
+
+static uint64_t
+ksm_node_hash (const struct hash_elem *e, void *aux UNUSED) {
+	return hash_entry (e, struct ksm_node, elem)->sum;
+}
+
+static bool
+ksm_node_less (const struct hash_elem *a, const struct hash_elem *b,
+		void *aux UNUSED) {
+	return hash_entry (a, struct ksm_node, elem)->sum
+		< hash_entry (b, struct ksm_node, elem)->sum;
+}
+
+static void
+ksm_node_free (struct hash_elem *e, void *aux UNUSED) {
+	free (hash_entry (e, struct ksm_node, elem));
+}
+
+/* Returns true if FRAME may be merged: in use, not pinned, and
+ * mapped only by anonymous pages of processes, none of them through
+ * a 2 MB page. */
+static bool
+ksm_mergeable (const struct frame *frame) {
+	if (!frame_evictable (frame))
+		return false;
+	for (struct page *page = frame->maps; page != NULL;
+			page = page->next_map) {
+		uint64_t *pte;
+
+		if (page->owner == NULL
+				|| VM_TYPE (page->operations->type) != VM_ANON)
+			return false;
+		pte = pml4e_walk (page_pml4 (page), (uint64_t) page->va, 0);
+		if (pte == NULL || is_huge_pte (pte))
+			return false;
+	}
+	return true;
+}
+
+/* Makes every mapping of FRAME read-only, so that its contents stay
+ * as they are while it is compared. */
+static void
+ksm_write_protect (struct frame *frame) {
+	for (struct page *page = frame->maps; page != NULL;
+			page = page->next_map)
+		pml4_set_writable (page_pml4 (page), page->va, false);
+}
+
+/* Lets go of the swap slot of PAGE, an anonymous page about to get
+ * a new, clean PTE, unless the slot still holds its contents: the
+ * dirty bit that told otherwise goes with the old PTE. */
+static void
+ksm_drop_stale_slot (struct page *page) {
+	if (page->anon.swap_slot != SWAP_SLOT_NONE
+			&& pml4_is_dirty (page_pml4 (page), page->va)) {
+		swap_free (page->anon.swap_slot);
+		page->anon.swap_slot = SWAP_SLOT_NONE;
+	}
+}
+
+/* Moves the pages of DUP over to KEEP, read-only, and frees DUP.
+ * Both are write-protected first, so that neither changes between
+ * the comparison and the move.  Returns false if they differ. */
+static bool
+ksm_merge (struct frame *keep, struct frame *dup) {
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	ksm_write_protect (keep);
+	ksm_write_protect (dup);
+	if (memcmp (keep->kva, dup->kva, PGSIZE) != 0)
+		return false;
+
+	while (dup->maps != NULL) {
+		struct page *page = dup->maps;
+
+		ksm_drop_stale_slot (page);
+		frame_unlink (page);
+		frame_link (keep, page);
+		pml4_set_page (page_pml4 (page), page->va, keep->kva, false);
+		ksm_merge_cnt++;
+	}
+	keep->ksm = true;
+	frame_free (dup);
+	ksm_freed_cnt++;
+	return true;
+}
+
+/* Maps the pages of FRAME, if it holds nothing but zeros, to the
+ * zero page and frees FRAME.  Returns false if it does not. */
+static bool
+ksm_merge_zero (struct frame *frame) {
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	ksm_write_protect (frame);
+	if (memcmp (frame->kva, zero_page, PGSIZE) != 0)
+		return false;
+
+	while (frame->maps != NULL) {
+		struct page *page = frame->maps;
+
+		/* The zero page stands only for pages with no slot. */
+		if (page->anon.swap_slot != SWAP_SLOT_NONE) {
+			swap_free (page->anon.swap_slot);
+			page->anon.swap_slot = SWAP_SLOT_NONE;
+		}
+		frame_unlink (page);
+		pml4_set_page (page_pml4 (page), page->va, zero_page, false);
+		ksm_zero_cnt++;
+	}
+	frame_free (frame);
+	ksm_freed_cnt++;
+	return true;
+}
+
+/* Looks at FRAME for this pass, whose stable frames are in STABLE:
+ * merges it with the one that has the same contents, or adds it. */
+static void
+ksm_scan_frame (struct frame *frame, struct hash *stable) {
+	struct ksm_node key, *node;
+	struct hash_elem *e;
+	uint64_t sum;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	if (!ksm_mergeable (frame))
+		return;
+	sum = hash_bytes (frame->kva, PGSIZE);
+	if (sum != frame->ksm_sum) {
+		/* New or changed since the last pass: not yet. */
+		frame->ksm_sum = sum;
+		return;
+	}
+	if (sum == ksm_zero_sum && ksm_merge_zero (frame))
+		return;
+
+	key.sum = sum;
+	e = hash_find (stable, &key.elem);
+	if (e == NULL) {
+		node = malloc (sizeof *node);
+		if (node != NULL) {
+			node->sum = sum;
+			node->frame = frame;
+			hash_insert (stable, &node->elem);
+		}
+		return;
+	}
+
+	/* The frame found may have been freed, reused or written to
+	 * since; then FRAME takes its place. */
+	node = hash_entry (e, struct ksm_node, elem);
+	if (node->frame != frame
+			&& (!ksm_mergeable (node->frame) || node->frame->ksm_sum != sum
+				|| !ksm_merge (node->frame, frame)))
+		node->frame = frame;
+}
+
+/* Same-page merging thread.  It runs at the lowest priority, when
+ * nothing else wants the CPU, and sleeps between batches. */
+static void
+ksmd (void *aux UNUSED) {
+	struct hash stable;
+
+	for (;;) {
+		if (!hash_init (&stable, ksm_node_hash, ksm_node_less, NULL)) {
+			timer_sleep (KSM_INTERVAL);
+			continue;
+		}
+		for (size_t base = 0; base < frame_cnt; base += KSM_BATCH) {
+			timer_sleep (KSM_INTERVAL);
+			lock_acquire (&frame_lock);
+			for (size_t i = base; i < base + KSM_BATCH && i < frame_cnt; i++)
+				ksm_scan_frame (&frame_table[i], &stable);
+			lock_release (&frame_lock);
+		}
+		hash_destroy (&stable, ksm_node_free);
+		ksm_pass_cnt++;
+	}
+}
+
+/* Starts ksmd. */
+static void
+ksm_start (void) {
+	ksm_zero_sum = hash_bytes (zero_page, PGSIZE);
+	thread_create ("ksmd", PRI_MIN, ksmd, NULL);
 }
 
 /* Return true on success */
@@ -242,13 +1556,27 @@ vm_try_handle_fault (struct intr_frame *f UNUSED, void *addr UNUSED, bool user U
 	// 유저 스택 포인터를 가져와야함
 	void *rsp_stack = is_kernel_vaddr(f->rsp) ? thread_current()->rsp_stack : f->rsp;
 	if (not_present) {
+		if (vm_thp_enabled && vm_claim_huge_page (addr))
+			return true;
+		// 0으로 채워진 페이지를 읽기만 하면 공용 zero page를 매핑한다
+		page = spt_find_page (spt, addr);
+		// 파일 매핑의 페이지는 처음 접근할 때 VMA를 보고 만든다
+		if (page == NULL) {
+			struct vma *vma = vma_find (&spt->vmas, addr);
+
+			if (vma != NULL && vma->type == VMA_MMAP
+					&& file_vma_page (vma, pg_round_down (addr)) == NULL)
+				return false;
+		}
+		if (page != NULL && !write && vm_map_zero_page (page))
+			return true;
 		// 페이지 못 불러온 경우
 		if (!vm_claim_page(addr)) {
 			// 유저스택내에 존재하는지 체크
-			if (rsp_stack - 8 <= addr && USER_STACK - 0x100000 <= addr && addr <= USER_STACK) {
-				vm_stack_growth(thread_current()->stack_bottom - PGSIZE);
-				return true;
-			}
+			// 한도 아래는 guard gap이므로 스택이 넘친 것이다
+			if (rsp_stack - 8 <= addr && USER_STACK - thread_current ()->stack_limit <= addr
+					&& addr < (void *) USER_STACK)
+				return vm_stack_growth (addr);
 			return false;
 		}
 		// 페이지 불러온경우
@@ -256,6 +1584,14 @@ vm_try_handle_fault (struct intr_frame *f UNUSED, void *addr UNUSED, bool user U
 			return true;
 		}
 	} 
+	// 공유 중인 페이지에 쓰기 (copy-on-write)
+	if (write) {
+		page = spt_find_page (spt, addr);
+		if (page != NULL && page->frame != NULL)
+			return vm_handle_wp (page);
+		if (page != NULL && page->writable && vm_page_maps_zero (page))
+			return vm_unmap_zero_page (page);
+	}
 	return false;
 }
 
@@ -284,100 +1620,153 @@ bool vm_claim_page (void *va UNUSED) {
 /* 인자로 받은 Page와 새 Frame을 서로 연결 */
 /* pml4_set_page() 함수로 프로세스의 pml4페이지 가상주소와 프레임 물리주소 매핑한 결과를 저장 */
 static bool vm_do_claim_page (struct page *page) {
-	struct frame *frame = vm_get_frame ();
+	struct frame *frame;
+	bool success = false;
+
+	/* 메모리 한도에 닿은 프로세스는 자기 페이지부터 내보낸다.
+	 * (fork 중에 부모의 페이지를 불러올 때는 하지 않는다) */
+	if (page->owner == thread_current () && over_mem_limit (page->owner))
+		mem_limit_reclaim (page->owner);
+
+	/* 파일 매핑은 파일의 page cache 프레임을 같이 쓴다. */
+	if (page_get_type (page) == VM_FILE)
+		return file_claim_page (page);
+
+	frame = vm_get_frame ();
 
 	/* Set links */
-	frame->page = page;
-	page->frame = frame;
+	lock_acquire (&frame_lock);
+	frame_link (frame, page);
+	lock_release (&frame_lock);
 
 	/* TODO: Insert page table entry to map page's VA to frame's PA. */
 	/* TODO: Insert page table entry to map page's VA to frame's PA. */
 	// page와 frame에 저장된 실제 physical memory 주소 (kernel vaddr) 관계를 page table에 등록
+	// (fork 중에는 부모의 페이지를 불러올 수도 있으므로 현재 스레드가 아닌 페이지 주인의 pml4에 등록)
 	
-	if (install_page(page->va, frame->kva, page->writable)) {
-		return swap_in(page, frame->kva);
+	if (pml4_get_page (page_pml4 (page), page->va) == NULL
+			&& pml4_set_page (page_pml4 (page), page->va, frame->kva, page->writable)) {
+		success = swap_in(page, frame->kva);
 	}
 
-	return false;
+	frame->pinned = false;
+	return success;
 }
 
-unsigned page_hash (const struct hash_elem *p_, void *aux UNUSED) {
-	const struct page *p = hash_entry (p_, struct page, hash_elem);
-	
-	return hash_bytes (&p->va, sizeof p->va);
-}
-
-bool page_less (const struct hash_elem *a_,
-           		const struct hash_elem *b_, void *aux UNUSED) {
-	const struct page *a = hash_entry (a_, struct page, hash_elem);
-  	const struct page *b = hash_entry (b_, struct page, hash_elem);
-
-  return a->va < b->va;
-}
-
-void *page_destory(struct hash_elem *h_elem, void *aux UNUSED){
-	struct page *p = hash_entry(h_elem, struct page, hash_elem);
-	vm_dealloc_page(p);
+static void
+page_destroy (uint64_t vpn UNUSED, void *page, void *aux UNUSED) {
+	vm_dealloc_page (page);
 }
 
 /* Initialize new supplemental page table */
 void
 supplemental_page_table_init (struct supplemental_page_table *spt UNUSED) {
-	hash_init (&spt->spt_table, page_hash, page_less, NULL);
+	radix_init (&spt->spt_table);
+	vma_tree_init (&spt->vmas);
+	memset (&spt->usage, 0, sizeof spt->usage);
+}
+
+/* Adds to the current process's SPT a copy-on-write twin of the
+ * parent's loaded page SRC.  Both map SRC's frame read-only until
+ * one of them writes to it (see vm_handle_wp()), so fork costs no
+ * copying.  A page the parent has swapped out is brought back in
+ * first.  A page of a file mapping is shared for good instead: the
+ * child maps the file's page cache page on its first access. */
+static bool
+vm_share_page (struct page *src) {
+	struct thread *curr = thread_current ();
+	enum vm_type type = src->operations->type;
+	struct vma *vma = NULL;
+	struct page *dst;
+
+	/* A page of a file mapping points at the child's copy of it. */
+	if (VM_TYPE (type) == VM_FILE)
+		vma = vma_find (&curr->spt.vmas, src->va);
+	if (!vm_alloc_page_with_initializer (type, src->va, src->writable,
+				NULL, vma))
+		return false;
+	if (VM_TYPE (type) == VM_FILE)
+		return true;
+
+	dst = spt_find_page (&curr->spt, src->va);
+
+	/* A swapped-out anonymous page is shared through its swap slot
+	 * and stays out; one that is all zeros (mapped to the zero page
+	 * or not) has nothing to share.  The parent waits for us, so
+	 * nothing can bring SRC back in meanwhile. */
+	if (src->frame == NULL && VM_TYPE (type) == VM_ANON) {
+		if (!swap_in (dst, NULL))
+			return false;
+		if (src->anon.swap_slot != SWAP_SLOT_NONE)
+			anon_share_swapped (dst, src);
+		return true;
+	}
+
+	/* Bring SRC in, and keep the clock off it while DST joins. */
+	for (;;) {
+		if (src->frame == NULL && !vm_do_claim_page (src))
+			return false;
+		lock_acquire (&frame_lock);
+		if (src->frame != NULL)
+			break;
+		lock_release (&frame_lock);
+	}
+
+	/* Turn DST into its final type; with no initializer and no
+	 * kva, this loads nothing. */
+	bool success = swap_in (dst, NULL);
+	if (success) {
+		frame_link (src->frame, dst);
+		pml4_set_writable (page_pml4 (src), src->va, false);
+		success = pml4_set_page (page_pml4 (dst), dst->va, src->frame->kva, false);
+	}
+	lock_release (&frame_lock);
+	return success;
 }
 
 /* Copy supplemental page table from src to dst */
 bool
 supplemental_page_table_copy (struct supplemental_page_table *dst UNUSED, struct supplemental_page_table *src UNUSED) {
 
-	struct hash_iterator i;
-	struct hash *child = &src->spt_table;
-	hash_first(&i, child);
-	while(hash_next(&i)) {
-		struct page	*page_entry = hash_entry (hash_cur (&i), struct page, hash_elem);
+	struct page *page_entry;
+	uint64_t vpn;
+
+	// 매핑(VMA)을 먼저 복사해 두면 파일 매핑 페이지가 자식의 VMA를 가리킬 수 있다.
+	if (!vma_tree_copy (&dst->vmas, &src->vmas))
+		return false;
+
+	// 채워진 부분만 주소 순서대로 방문한다.
+	for (vpn = 0; (page_entry = radix_next (&src->spt_table, &vpn)) != NULL; vpn++) {
 
 		enum vm_type type = page_entry->operations->type;
 		void *upage = page_entry->va;
 		bool writable = page_entry->writable;
 		void *aux = page_entry->uninit.aux;
-		struct file_info *file_info;
-		struct page *new_page;
 
 		switch(VM_TYPE(type)){
 
 			case VM_UNINIT :
-				file_info = (struct file_info *)malloc(sizeof(struct file_info));
-
-				memcpy(file_info, (struct file_info*)page_entry->uninit.aux, sizeof(struct file_info));
-				vm_alloc_page_with_initializer(VM_ANON, upage, writable, page_entry->uninit.init, file_info);
-				break;
-
-			case VM_ANON :
-
-				if(!(vm_alloc_page(type, upage, writable))){
-					return false;
-				}
-
-				new_page = spt_find_page(dst, upage);
-				if(!vm_claim_page(upage)){
+				// 0으로 채워질 페이지는 aux가 없다
+				// 파일에서 읽을 페이지의 aux는 페이지가 속한 VMA이므로 자식의 VMA로 바꾼다
+				if (aux != NULL)
+					aux = vma_find (&dst->vmas, upage);
+				if (!vm_alloc_page_with_initializer(page_entry->type, upage, writable, page_entry->uninit.init, aux))
 					return false;
-
-				}
-				memcpy(new_page->frame->kva, page_entry->frame->kva, PGSIZE);
 				break;
 
+			case VM_ANON :
 			case VM_FILE :
-				if(!(vm_alloc_page(type, upage, writable))){
+				// 복사하지 않고 부모의 프레임을 읽기 전용으로 공유한다.
+				if (!vm_share_page (page_entry)) {
 					return false;
 				}
-
-				new_page = spt_find_page(dst, upage);
-				if(!vm_claim_page(upage)){
-					return false;
-				}
-				memcpy(new_page->frame->kva, page_entry->frame->kva, PGSIZE);
 				break;
 		}			
+
+		// madvise()로 준 힌트도 물려준다
+		struct page *child = spt_find_page (dst, upage);
+		if (child != NULL)
+			child->advice = page_entry->advice;
 	}
 
 	return true;
@@ -388,18 +1777,8 @@ void
 supplemental_page_table_kill (struct supplemental_page_table *spt UNUSED) {
 	/* TODO: Destroy all the supplemental_page_table hold by thread and
 	 * TODO: writeback all the modified contents to the storage. */
-	struct hash_iterator i;
-	if (spt->spt_table.buckets != NULL)
-	{
-		hash_first(&i, &spt->spt_table);
-		while(hash_next(&i))
-		{
-			struct page *page = hash_entry(hash_cur(&i), struct page, hash_elem);
-			if (page->operations->type == VM_FILE)
-			{
-				do_munmap(page->va);
-			}
-		}
-	}
-	hash_destroy(&spt->spt_table, page_destory);
+	// 파일 매핑 페이지는 destroy될 때 dirty bit을 page cache에 넘기고,
+	// 파일에 쓰는 것은 page cache가 한다.
+	radix_destroy(&spt->spt_table, page_destroy, NULL);
+	vma_tree_destroy (&spt->vmas);
 }
\ No newline at end of file
@@ -0,0 +1,368 @@
+/* vma.c: Virtual memory areas.
+ *
+ * Each process keeps the regions of its address space (executable
+ * segments, the stack, and each mmap()) in an AVL tree ordered by
+ * start address.  As the areas never overlap, the same order finds
+ * the area containing an address, or any area overlapping a range,
+ * in O(log n).  Every node also records the span of its subtree and
+ * the largest hole between areas in it, so that a first-fit search
+ * for free space skips the subtrees where it cannot fit.
+ *
+ * A file mapping's struct pages are made only when first touched
+ * (see vm_try_handle_fault()); the area records what they map as a
+ * whole, so that munmap() and exit deal with each mapping once. */
+
+#include "vm/vm.h"
+#include "vm/vma.h"
+#include <debug.h>
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/vaddr.h"
+#include "userprog/process.h"
+
+/* Initializes TREE as empty. */
+void
+vma_tree_init (struct vma_tree *tree) {
+	tree->root = NULL;
+	tree->cnt = 0;
+}
+
+/* ---- AVL tree ---- */
+
+static int
+height (const struct vma *v) {
+	return v != NULL ? v->height : 0;
+}
+
+/* Recomputes V's height and subtree summary from its children's. */
+static void
+update (struct vma *v) {
+	int l = height (v->left), r = height (v->right);
+	size_t gap = 0;
+
+	v->height = (l > r ? l : r) + 1;
+	v->sub_start = v->left != NULL ? v->left->sub_start : v->start;
+	v->sub_end = v->right != NULL ? v->right->sub_end : v->end;
+	if (v->left != NULL) {
+		gap = v->left->sub_gap;
+		if ((size_t) (v->start - v->left->sub_end) > gap)
+			gap = v->start - v->left->sub_end;
+	}
+	if (v->right != NULL) {
+		if (v->right->sub_gap > gap)
+			gap = v->right->sub_gap;
+		if ((size_t) (v->right->sub_start - v->end) > gap)
+			gap = v->right->sub_start - v->end;
+	}
+	v->sub_gap = gap;
+}
+
+static struct vma *
+rotate_right (struct vma *v) {
+	struct vma *l = v->left;
+
+	v->left = l->right;
+	l->right = v;
+	update (v);
+	update (l);
+	return l;
+}
+
+static struct vma *
+rotate_left (struct vma *v) {
+	struct vma *r = v->right;
+
+	v->right = r->left;
+	r->left = v;
+	update (v);
+	update (r);
+	return r;
+}
+
+/* Restores the AVL balance of the subtree V, whose children are
+ * balanced and differ in height by at most 2, and returns its new
+ * root. */
+static struct vma *
+rebalance (struct vma *v) {
+	int balance;
+
+	update (v);
+	balance = height (v->left) - height (v->right);
+	if (balance > 1) {
+		if (height (v->left->left) < height (v->left->right))
+			v->left = rotate_left (v->left);
+		return rotate_right (v);
+	}
+	if (balance < -1) {
+		if (height (v->right->right) < height (v->right->left))
+			v->right = rotate_right (v->right);
+		return rotate_left (v);
+	}
+	return v;
+}
+
+/* Inserts VMA into the subtree ROOT and returns its new root. */
+static struct vma *
+insert_node (struct vma *root, struct vma *vma) {
+	if (root == NULL) {
+		vma->left = vma->right = NULL;
+		update (vma);
+		return vma;
+	}
+	if (vma->start < root->start)
+		root->left = insert_node (root->left, vma);
+	else
+		root->right = insert_node (root->right, vma);
+	return rebalance (root);
+}
+
+/* Takes the leftmost node out of the subtree ROOT, stores it in
+ * *MIN, and returns the subtree's new root. */
+static struct vma *
+remove_min (struct vma *root, struct vma **min) {
+	if (root->left == NULL) {
+		*min = root;
+		return root->right;
+	}
+	root->left = remove_min (root->left, min);
+	return rebalance (root);
+}
+
+/* Removes VMA from the subtree ROOT and returns its new root. */
+static struct vma *
+remove_node (struct vma *root, struct vma *vma) {
+	struct vma *min;
+
+	ASSERT (root != NULL);
+
+	if (vma->start < root->start)
+		root->left = remove_node (root->left, vma);
+	else if (vma->start > root->start)
+		root->right = remove_node (root->right, vma);
+	else {
+		if (root->left == NULL)
+			return root->right;
+		if (root->right == NULL)
+			return root->left;
+		root->right = remove_min (root->right, &min);
+		min->left = root->left;
+		min->right = root->right;
+		return rebalance (min);
+	}
+	return rebalance (root);
+}
+
+/* ---- Areas ---- */
+
+/* Adds to TREE an area of TYPE mapping the bytes of FILE from OFFSET
+ * at START up to END, with a file of its own, or only reserving the
+ * range if FILE is null.  Returns a null pointer if the range overlaps
+ * an area of TREE or memory is exhausted. */
+struct vma *
+vma_create (struct vma_tree *tree, void *start, void *end,
+		enum vma_type type, struct file *file, off_t offset, bool writable) {
+	struct vma *vma;
+
+	ASSERT (pg_ofs (start) == 0 && pg_ofs (end) == 0 && start < end);
+
+	if (vma_overlaps (tree, start, end))
+		return NULL;
+	vma = malloc (sizeof *vma);
+	if (vma == NULL)
+		return NULL;
+	vma->file = NULL;
+	if (file != NULL && (vma->file = file_reopen (file)) == NULL) {
+		free (vma);
+		return NULL;
+	}
+	vma->start = start;
+	vma->end = end;
+	vma->type = type;
+	vma->offset = offset;
+	vma->file_bytes = file != NULL ? (size_t) (end - start) : 0;
+	vma->writable = writable;
+	tree->root = insert_node (tree->root, vma);
+	tree->cnt++;
+	return vma;
+}
+
+/* Frees VMA, whose pages are gone, after handing its part of the
+ * file to the page cache's writeback thread: written pages are
+ * written back in file order, in as few disk commands as they can
+ * be. */
+static void
+vma_free (struct vma *vma) {
+	if (vma->type == VMA_MMAP)
+		page_cache_writeback_range (file_get_inode (vma->file),
+				vma->offset / PGSIZE, (vma->end - vma->start) / PGSIZE, false);
+	file_close (vma->file);
+	free (vma);
+}
+
+/* Removes VMA, whose pages are gone, from TREE and frees it. */
+void
+vma_destroy (struct vma_tree *tree, struct vma *vma) {
+	tree->root = remove_node (tree->root, vma);
+	tree->cnt--;
+	vma_free (vma);
+}
+
+/* Frees the subtree V. */
+static void
+destroy_subtree (struct vma *v) {
+	if (v != NULL) {
+		destroy_subtree (v->left);
+		destroy_subtree (v->right);
+		vma_free (v);
+	}
+}
+
+/* Frees every area of TREE, whose pages are gone, and leaves it
+ * empty. */
+void
+vma_tree_destroy (struct vma_tree *tree) {
+	destroy_subtree (tree->root);
+	vma_tree_init (tree);
+}
+
+/* Adds a copy of each area of SRC to DST, which is empty, for a
+ * child process.  Returns false if memory is exhausted. */
+bool
+vma_tree_copy (struct vma_tree *dst, const struct vma_tree *src) {
+	for (struct vma *v = vma_first (src); v != NULL; v = vma_next (src, v)) {
+		struct vma *copy = vma_create (dst, v->start, v->end, v->type,
+				v->file, v->offset, v->writable);
+
+		if (copy == NULL)
+			return false;
+		copy->file_bytes = v->file_bytes;
+	}
+	return true;
+}
+
+/* Fills INFO with where the contents of the page at VA of VMA, a
+ * file-backed area, come from. */
+void
+vma_file_info (struct vma *vma, void *va, struct file_info *info) {
+	size_t ofs = va - vma->start;
+
+	ASSERT (vma->file != NULL && vma->start <= va && va < vma->end);
+
+	info->file = vma->file;
+	info->ofs = vma->offset + ofs;
+	info->read_bytes = 0;
+	if (ofs < vma->file_bytes)
+		info->read_bytes = vma->file_bytes - ofs < PGSIZE
+			? vma->file_bytes - ofs : PGSIZE;
+	info->vma = vma;
+}
+
+/* ---- Search ---- */
+
+/* Returns the area of TREE that contains ADDR, or a null pointer if
+ * there is none. */
+struct vma *
+vma_find (const struct vma_tree *tree, const void *addr) {
+	struct vma *v = tree->root;
+
+	while (v != NULL) {
+		if (addr < v->start)
+			v = v->left;
+		else if (addr >= v->end)
+			v = v->right;
+		else
+			return v;
+	}
+	return NULL;
+}
+
+/* Returns true if an area of TREE overlaps the range from START up
+ * to END. */
+bool
+vma_overlaps (const struct vma_tree *tree, const void *start,
+		const void *end) {
+	struct vma *v = tree->root;
+
+	while (v != NULL) {
+		if (end <= v->start)
+			v = v->left;
+		else if (start >= v->end)
+			v = v->right;
+		else
+			return true;
+	}
+	return false;
+}
+
+/* Returns the lowest area of TREE, or a null pointer if it is
+ * empty. */
+struct vma *
+vma_first (const struct vma_tree *tree) {
+	struct vma *v = tree->root;
+
+	while (v != NULL && v->left != NULL)
+		v = v->left;
+	return v;
+}
+
+/* Returns the area of TREE after VMA, or a null pointer if VMA is
+ * the last. */
+struct vma *
+vma_next (const struct vma_tree *tree, const struct vma *vma) {
+	struct vma *v = tree->root, *next = NULL;
+
+	while (v != NULL) {
+		if (vma->start < v->start) {
+			next = v;
+			v = v->left;
+		}
+		else
+			v = v->right;
+	}
+	return next;
+}
+
+/* Returns true if the range from START up to END holds LENGTH
+ * bytes. */
+static bool
+fits (const uint8_t *start, const uint8_t *end, size_t length) {
+	return start < end && (size_t) (end - start) >= length;
+}
+
+/* Returns the lowest address at or above LO, and at most HI -
+ * LENGTH, of LENGTH free bytes in the range from BELOW up to ABOVE,
+ * where the areas of subtree V are, or a null pointer if there is
+ * none. */
+static void *
+find_gap (const struct vma *v, uint8_t *below, uint8_t *above,
+		size_t length, uint8_t *lo, uint8_t *hi) {
+	void *addr;
+
+	if (above <= lo || below >= hi)
+		return NULL;
+	if (v == NULL) {
+		uint8_t *start = below > lo ? below : lo;
+		uint8_t *end = above < hi ? above : hi;
+
+		return fits (start, end, length) ? start : NULL;
+	}
+	if (!fits (below, v->sub_start, length) && !fits (v->sub_end, above, length)
+			&& v->sub_gap < length)
+		return NULL;
+
+	addr = find_gap (v->left, below, v->start, length, lo, hi);
+	if (addr == NULL)
+		addr = find_gap (v->right, v->end, above, length, lo, hi);
+	return addr;
+}
+
+/* Returns the lowest address of LENGTH bytes, from LO up to HI, that
+ * no area of TREE overlaps (first fit), or a null pointer if there is
+ * none.  Subtrees without a large enough hole are not visited. */
+void *
+vma_find_gap (const struct vma_tree *tree, size_t length, void *lo,
+		void *hi) {
+	ASSERT (length > 0);
+
+	return find_gap (tree->root, lo, hi, length, lo, hi);
+}
@@ -0,0 +1,199 @@
+/* zswap.c: Compressed pool of swapped-out pages in kernel memory.
+ *
+ * Sits in front of the swap disk.  A page written to a swap slot is
+ * first compressed, and if it shrinks to ZSWAP_MAX_LEN bytes or less
+ * it is kept here under its slot instead of going to disk.  Reading
+ * the slot back then costs a decompression rather than a disk read.
+ * The slot is still allocated on disk, so that when the pool is full
+ * its oldest pages can be written back there. */
+
+#include "vm/zswap.h"
+#include <debug.h>
+#include <list.h>
+#include <lz4.h>
+#include <radix.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* An entry must fit the largest malloc() size class; one bigger
+ * would take a page of its own and save nothing. */
+#define ZSWAP_BLOCK_MAX (PGSIZE / 4)
+
+/* The pool may hold at most 1/ZSWAP_POOL_DIV of the user pool's
+ * size in compressed data. */
+#define ZSWAP_POOL_DIV 5
+
+/* A compressed page. */
+struct zswap_entry {
+	swap_slot_t slot;           /* Slot the page was written to. */
+	struct list_elem lru_elem;  /* Element in LRU, oldest first. */
+	size_t len;                 /* Compressed size. */
+	uint8_t data[];             /* Compressed page. */
+};
+
+/* Pages that do not compress to this size go straight to disk. */
+#define ZSWAP_MAX_LEN (ZSWAP_BLOCK_MAX - sizeof (struct zswap_entry))
+
+bool zswap_disabled;
+
+static struct radix tree;       /* Entries by slot. */
+static struct list lru;         /* Entries in the order they came. */
+static size_t pool_bytes;       /* Memory held by entries, counted
+                                   in malloc() blocks. */
+static size_t pool_max;         /* Limit on POOL_BYTES. */
+static struct lock zswap_lock;  /* Protects everything in this file. */
+
+/* Scratch space, used under ZSWAP_LOCK. */
+static uint8_t comp_buf[ZSWAP_MAX_LEN];
+static uint16_t lz4_wrkmem[LZ4_WORKMEM_SIZE / sizeof (uint16_t)];
+static void *writeback_page;
+
+/* Statistics. */
+static unsigned long long store_cnt;        /* Pages taken in. */
+static unsigned long long reject_cnt;       /* ...or turned away. */
+static unsigned long long load_cnt;         /* Slots read from the pool. */
+static unsigned long long writeback_cnt;    /* Pages moved to disk. */
+static unsigned long long stored_bytes;     /* Compressed size of all
+                                               pages taken in. */
+
+/* Sets up the pool, sized after the user pool. */
+void
+zswap_init (void) {
+	size_t user_pages;
+
+	radix_init (&tree);
+	list_init (&lru);
+	lock_init (&zswap_lock);
+	palloc_user_pool_range (&user_pages);
+	pool_max = user_pages / ZSWAP_POOL_DIV * PGSIZE;
+	writeback_page = palloc_get_page (0);
+	if (writeback_page == NULL)
+		PANIC ("zswap: no memory for writeback page");
+}
+
+/* Returns the memory taken by an entry holding LEN bytes. */
+static size_t
+entry_bytes (size_t len) {
+	return malloc_block_size (sizeof (struct zswap_entry) + len);
+}
+
+/* Removes E from the pool and frees it. */
+static void
+entry_free (struct zswap_entry *e) {
+	radix_delete (&tree, e->slot);
+	list_remove (&e->lru_elem);
+	pool_bytes -= entry_bytes (e->len);
+	free (e);
+}
+
+/* Writes the oldest page in the pool back to its slot on disk and
+ * drops it from the pool. */
+static void
+writeback_oldest (void) {
+	struct zswap_entry *e = list_entry (list_front (&lru),
+			struct zswap_entry, lru_elem);
+	size_t len = lz4_decompress (e->data, e->len, writeback_page, PGSIZE);
+
+	ASSERT (len == PGSIZE);
+	swap_writeback (e->slot, writeback_page);
+	entry_free (e);
+	writeback_cnt++;
+}
+
+/* Compresses the page at KVA and keeps it under SLOT.  Returns false
+ * if the page should go to disk instead: it does not compress well,
+ * or the pool is disabled or out of memory. */
+bool
+zswap_store (swap_slot_t slot, const void *kva) {
+	struct zswap_entry *e;
+	size_t len, bytes;
+
+	if (zswap_disabled)
+		return false;
+
+	lock_acquire (&zswap_lock);
+	len = lz4_compress (kva, PGSIZE, comp_buf, sizeof comp_buf, lz4_wrkmem);
+	if (len == 0)
+		goto reject;
+	bytes = entry_bytes (len);
+	if (bytes > ZSWAP_BLOCK_MAX)
+		goto reject;
+
+	/* Make room by writing back the oldest pages. */
+	while (pool_bytes + bytes > pool_max && !list_empty (&lru))
+		writeback_oldest ();
+	if (pool_bytes + bytes > pool_max)
+		goto reject;
+
+	e = malloc (sizeof *e + len);
+	if (e == NULL)
+		goto reject;
+	e->slot = slot;
+	e->len = len;
+	memcpy (e->data, comp_buf, len);
+	if (!radix_insert (&tree, slot, e)) {
+		free (e);
+		goto reject;
+	}
+	list_push_back (&lru, &e->lru_elem);
+	pool_bytes += bytes;
+	store_cnt++;
+	stored_bytes += len;
+	lock_release (&zswap_lock);
+	return true;
+
+reject:
+	reject_cnt++;
+	lock_release (&zswap_lock);
+	return false;
+}
+
+/* Reads the page kept under SLOT into KVA.  Returns false if the
+ * pool does not have it, in which case it is on disk.  The entry
+ * stays until the slot is freed, for the page may be evicted again
+ * unchanged. */
+bool
+zswap_load (swap_slot_t slot, void *kva) {
+	struct zswap_entry *e;
+	size_t len;
+
+	lock_acquire (&zswap_lock);
+	e = radix_lookup (&tree, slot);
+	if (e != NULL) {
+		len = lz4_decompress (e->data, e->len, kva, PGSIZE);
+		ASSERT (len == PGSIZE);
+		load_cnt++;
+	}
+	lock_release (&zswap_lock);
+	return e != NULL;
+}
+
+/* Drops the page kept under SLOT, if any, because the slot is being
+ * freed. */
+void
+zswap_invalidate (swap_slot_t slot) {
+	struct zswap_entry *e;
+
+	lock_acquire (&zswap_lock);
+	e = radix_lookup (&tree, slot);
+	if (e != NULL)
+		entry_free (e);
+	lock_release (&zswap_lock);
+}
+
+/* Prints pool statistics. */
+void
+zswap_print_stats (void) {
+	/* Compression ratio in hundredths. */
+	unsigned long long ratio = stored_bytes > 0
+		? store_cnt * PGSIZE * 100 / stored_bytes : 0;
+
+	printf ("Zswap: %zu pages in %zu/%zu bytes, %llu stored (ratio "
+			"%llu.%02llu:1), %llu rejected, %llu loads, %llu written back\n",
+			radix_size (&tree), pool_bytes, pool_max, store_cnt,
+			ratio / 100, ratio % 100, reject_cnt, load_cnt, writeback_cnt);
+}